@@ -0,0 +1,190 @@
+// 请求处理微基准：HTTPConn::process_read（解析+查找文件）与process_write（生成响应）在预置请求上的耗时，
+// 每种HTTP_CODE至少一个用例；不经过套接字，只测量reactor/工作线程中的CPU开销
+// HTTPConnBench是HTTPConn的友元，直接驱动其私有的解析和响应函数
+// 用法：bin/http_bench [迭代次数]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "http_conn.h"
+#include "config.h"
+#include "file_cache.h"
+#include "content_cache.h"
+#include "buffer_pool.h"
+#include "timer_wheel.h"
+
+Config cfg;
+
+static const int REPEAT = 5;
+
+class HTTPConnBench {
+public:
+    explicit HTTPConnBench(BufferPool* pool, TimerWheel* timers) {
+        m_conn.m_sockfd = -1;
+        m_conn.m_pool = pool;
+        m_conn.m_timers = timers;
+        m_conn.m_timer.owner = &m_conn;
+        m_conn.init();
+    }
+
+    // 把请求放入读缓冲区，解析状态回到请求开始（解析会原地修改缓冲区，每次都重新复制）
+    void load(const std::string& req) {
+        m_conn.ensure_read_buf();
+        memcpy(m_conn.m_read_buf, req.data(), req.size());
+        m_conn.m_end_pos = req.size();
+        m_conn.m_cur_pos = 0;
+        m_conn.m_start_line = 0;
+        m_conn.m_req_start = 0;
+        m_conn.reset_request();
+    }
+    HTTPConn::HTTP_CODE parse() {
+        return m_conn.process_read();
+    }
+    // 丢弃解析得到的文件资源（只测解析时使用）
+    void discard() {
+        m_conn.unmap();
+    }
+    bool respond(HTTPConn::HTTP_CODE code) {
+        return m_conn.process_write(code);
+    }
+    // 响应已发送：释放响应队列和写缓冲区
+    void finish() {
+        m_conn.release_responses();
+    }
+    int response_bytes() const {
+        return m_conn.m_write_idx;
+    }
+
+private:
+    HTTPConn m_conn;
+};
+
+struct Case {
+    const char* name;
+    std::string req;
+    HTTPConn::HTTP_CODE code;   // 期望的解析结果
+    bool parse;                 // false：不经过解析，直接用code生成响应（解析器不会产生的代码）
+    bool sendfile;
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static std::string get(const char* url, const char* extra = "") {
+    return std::string("GET ") + url + " HTTP/1.1\r\nHost: 127.0.0.1:1234\r\n"
+           "User-Agent: curl/8.5.0\r\nAccept: */*\r\n" + extra + "\r\n";
+}
+
+static bool write_file(const std::string& path, size_t size) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        fputc('a' + i % 26, fp);
+    }
+    fclose(fp);
+    return true;
+}
+
+// 单次耗时的中位数（纳秒）
+static double measure(HTTPConnBench& b, const Case& c, bool respond, long iters) {
+    std::vector<double> runs;
+    for (int r = 0; r < REPEAT; r++) {
+        uint64_t t0 = now_ns();
+        for (long i = 0; i < iters; i++) {
+            HTTPConn::HTTP_CODE code = c.code;
+            b.load(c.req);
+            if (c.parse) {
+                code = b.parse();
+            }
+            if (respond) {
+                b.respond(code);
+                b.finish();
+            } else {
+                b.discard();
+            }
+        }
+        runs.push_back((double)(now_ns() - t0) / iters);
+    }
+    std::sort(runs.begin(), runs.end());
+    return runs[REPEAT / 2];
+}
+
+int main(int argc, char* argv[]) {
+    long iters = argc > 1 ? atol(argv[1]) : 200000;
+
+    char root[] = "/tmp/http_bench.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = root;
+    if (!write_file(dir + "/index.html", 1024) || !write_file(dir + "/big.bin", 65536)) {
+        perror("write_file");
+        return 1;
+    }
+
+    cfg.init_default();
+    strcpy(cfg.doc_root, root);
+    Config sendfile_cfg = cfg;
+    sendfile_cfg.use_sendfile = true;
+    file_cache.init(cfg.doc_root, true, cfg.file_cache_shards, cfg.file_cache_entries, cfg.file_cache_ttl);
+    content_cache.init(true, cfg.file_cache_shards, cfg.content_cache_max_file, (size_t)cfg.content_cache_size * 1024);
+
+    BufferPool pool;
+    TimerWheel timers;
+    HTTPConnBench bench(&pool, &timers);
+
+    const char* FUTURE = "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n";
+    std::vector<Case> cases = {
+        {"200 cached", get("/index.html"), HTTPConn::FILE_REQUEST, true, false},
+        {"200 mmap", get("/big.bin"), HTTPConn::FILE_REQUEST, true, false},
+        {"200 sendfile", get("/big.bin"), HTTPConn::FILE_REQUEST, true, true},
+        {"206 single", get("/big.bin", "Range: bytes=0-99\r\n"), HTTPConn::FILE_REQUEST, true, false},
+        {"206 multi", get("/big.bin", "Range: bytes=0-99,1000-1999,-100\r\n"), HTTPConn::FILE_REQUEST, true, false},
+        {"304", get("/index.html", FUTURE), HTTPConn::NOT_MODIFIED, true, false},
+        {"416", get("/big.bin", "Range: bytes=100000-\r\n"), HTTPConn::RANGE_NOT_SATISFIABLE, true, false},
+        {"400", "GARBAGE\r\n\r\n", HTTPConn::BAD_REQUEST, true, false},
+        {"403", get("/../etc/passwd"), HTTPConn::FORBIDDEN_REQUEST, true, false},
+        {"404", get("/missing.html"), HTTPConn::NO_RESOURCE, true, false},
+        {"500", get("/index.html"), HTTPConn::INTERNAL_ERROR, false, false},
+        {"503", get("/index.html"), HTTPConn::SERVICE_UNAVAILABLE, false, false},
+        {"stats", get("/__stats"), HTTPConn::STATS_REQUEST, true, false},
+    };
+
+    printf("%-13s %6s %10s %10s %10s\n", "case", "header", "parse ns", "write ns", "total ns");
+    int failed = 0;
+    for (const Case& c : cases) {
+        g_live_cfg.store(c.sendfile ? &sendfile_cfg : &cfg);
+        // 先执行一次：检查解析结果，同时填充文件缓存和内容缓存
+        bench.load(c.req);
+        HTTPConn::HTTP_CODE code = c.parse ? bench.parse() : c.code;
+        if (code != c.code || !bench.respond(code)) {
+            printf("%-13s MISMATCH: parse returned %d, expected %d\n", c.name, (int)code, (int)c.code);
+            bench.finish();
+            failed = 1;
+            continue;
+        }
+        int bytes = bench.response_bytes();
+        bench.finish();
+        double parse = c.parse ? measure(bench, c, false, iters) : 0;
+        double total = measure(bench, c, true, iters);
+        printf("%-13s %6d %10.1f %10.1f %10.1f\n", c.name, bytes, parse, total - parse, total);
+    }
+    g_live_cfg.store(&cfg);
+
+    unlink((dir + "/index.html").c_str());
+    unlink((dir + "/big.bin").c_str());
+    rmdir(root);
+    return failed;
+}
@@ -0,0 +1,631 @@
+// HTTP/1.1压测工具：每个线程一个epoll，负责一部分连接
+// 用法：bin/loadgen [选项] host:port
+//   -c N    连接数（默认64）
+//   -t N    线程数（默认2）
+//   -d S    统计时长，秒（默认10）
+//   -w S    预热时长，秒，期间完成的请求不计入结果（默认1）
+//   -p N    每个连接的管线化深度（默认1，最大64）
+//   -C      短连接：每个请求带Connection: close，响应后重新建立连接（管线化深度固定为1）
+//   -R N    目标总请求速率（请求/秒）；0表示闭环，每个连接收到响应后立即发送下一个请求（默认0）
+//   -u FILE URL列表，每行"[权重] URL"，#开始的行为注释（默认只请求/）
+//   -n NAME 结果中的名字
+// 结果以一行JSON输出到stdout，可读的摘要输出到stderr
+//
+// 协调遗漏（coordinated omission）：闭环测试时，服务器卡住的那段时间里客户端也停止发送，
+//  这段时间本应发出的请求从来没有被测量，高分位延迟因此被严重低估。
+//  - 指定-R时，每个连接按固定间隔安排请求，延迟从计划发送时间开始计算（与wrk2相同），
+//    连接被阻塞时后续请求的等待时间也计入延迟；
+//  - 闭环时按HdrHistogram的方式事后修正：以每个连接发出请求的平均间隔为期望间隔，
+//    对每个超过期望间隔的延迟v，补记v - 间隔、v - 2 * 间隔……这些本应被测量到的请求。
+//  两种情况都同时给出未修正的延迟（从实际发送开始计算）用于对比。
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+static const int MAX_DEPTH = 64;
+static const int RECV_BUF = 16384;
+
+struct Options {
+    const char* host;
+    int port;
+    int conns;
+    int threads;
+    double duration;
+    double warmup;
+    int depth;
+    bool close_mode;
+    double rate;
+    const char* url_file;
+    const char* name;
+};
+
+// 按权重选择的请求，请求报文预先生成
+struct UrlMix {
+    std::vector<std::string> urls;
+    std::vector<std::string> reqs;
+    std::vector<uint64_t> cum;  // 累积权重
+
+    size_t pick(uint64_t r) const {
+        uint64_t x = r % cum.back();
+        size_t lo = 0, hi = cum.size() - 1;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (cum[mid] > x) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return lo;
+    }
+};
+
+static uint64_t now_ns() {
+    return Metrics::now_ns();
+}
+
+static uint64_t xorshift(uint64_t& s) {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+}
+
+struct Conn {
+    int fd;
+    uint32_t gen;       // 每次建立连接加一（重新连接后fd可能相同）
+    bool connecting;
+    std::string out;
+    size_t out_off;
+    // 已发出（或已排队）、尚未收到响应的请求，按发送顺序
+    uint64_t intended[MAX_DEPTH];
+    uint64_t sent[MAX_DEPTH];
+    int head;
+    int count;
+    uint64_t next_ns;   // -R：下一个请求的计划发送时间
+    // 响应解析
+    char buf[RECV_BUF];
+    int len;
+    bool in_body;
+    uint64_t body_left;
+    int status;
+    bool server_close;
+};
+
+struct Worker {
+    const Options* opt;
+    const UrlMix* mix;
+    const sockaddr_in* addr;
+    int first_conn;
+    int nconns;
+    uint64_t start_ns;
+    uint64_t measure_ns;    // 预热结束
+    uint64_t end_ns;
+    uint64_t interval_ns;   // -R：每个连接的请求间隔
+    uint64_t rng;
+
+    int epollfd;
+    std::vector<Conn*> conns;
+
+    // 结果（只统计预热结束后完成的请求）
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t connects;
+    uint64_t status[6];     // 1xx-5xx，下标0为其他
+    HistogramSnapshot corrected;
+    HistogramSnapshot uncorrected;
+};
+
+static void usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-c conns] [-t threads] [-d sec] [-w sec] [-p depth] [-C] [-R rate] "
+                    "[-u urlfile] [-n name] host:port\n", prog);
+    exit(1);
+}
+
+static bool load_urls(const Options& opt, UrlMix* mix) {
+    if (opt.url_file) {
+        FILE* fp = fopen(opt.url_file, "r");
+        if (!fp) {
+            perror(opt.url_file);
+            return false;
+        }
+        char line[1024];
+        uint64_t total = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            char* p = line;
+            while (*p == ' ' || *p == '\t') {
+                p++;
+            }
+            if (*p == '#' || *p == '\n' || *p == '\0') {
+                continue;
+            }
+            uint64_t weight = 1;
+            if (*p >= '0' && *p <= '9') {
+                weight = strtoull(p, &p, 10);
+                while (*p == ' ' || *p == '\t') {
+                    p++;
+                }
+            }
+            char* end = p + strcspn(p, " \t\r\n");
+            *end = '\0';
+            if (*p != '/' || weight == 0) {
+                fprintf(stderr, "%s: bad line: %s\n", opt.url_file, line);
+                fclose(fp);
+                return false;
+            }
+            total += weight;
+            mix->urls.push_back(p);
+            mix->cum.push_back(total);
+        }
+        fclose(fp);
+    }
+    if (mix->urls.empty()) {
+        mix->urls.push_back("/");
+        mix->cum.push_back(1);
+    }
+    char host[128];
+    snprintf(host, sizeof(host), "%s:%d", opt.host, opt.port);
+    for (size_t i = 0; i < mix->urls.size(); i++) {
+        mix->reqs.push_back("GET " + mix->urls[i] + " HTTP/1.1\r\nHost: " + host + "\r\n"
+                            + (opt.close_mode ? "Connection: close\r\n" : "") + "\r\n");
+    }
+    return true;
+}
+
+static void queue_request(Worker* w, Conn* c, uint64_t intended, uint64_t now) {
+    int slot = (c->head + c->count) % MAX_DEPTH;
+    c->intended[slot] = intended;
+    c->sent[slot] = now;
+    c->count++;
+    c->out += w->mix->reqs[w->mix->pick(xorshift(w->rng))];
+}
+
+static bool flush(Conn* c) {
+    if (c->fd < 0) {
+        return true;    // 测试已结束，没有重新连接
+    }
+    while (c->out_off < c->out.size()) {
+        ssize_t n = send(c->fd, c->out.data() + c->out_off, c->out.size() - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;    // 等待EPOLLOUT
+            }
+            return false;
+        }
+        c->out_off += n;
+    }
+    c->out.clear();
+    c->out_off = 0;
+    return true;
+}
+
+// 按模式补充请求：闭环时保持depth个请求在途，-R时发出所有已到计划时间的请求
+static void fill(Worker* w, Conn* c, uint64_t now) {
+    if (c->connecting || now >= w->end_ns) {
+        return;
+    }
+    int depth = w->opt->close_mode ? 1 : w->opt->depth;
+    if (w->interval_ns == 0) {
+        while (c->count < depth) {
+            queue_request(w, c, now, now);
+        }
+    } else {
+        while (c->count < depth && c->next_ns <= now) {
+            queue_request(w, c, c->next_ns, now);
+            c->next_ns += w->interval_ns;
+        }
+    }
+}
+
+static bool open_conn(Worker* w, Conn* c) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) {
+        perror("socket");
+        exit(1);
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->gen++;
+    c->connecting = true;
+    c->out.clear();
+    c->out_off = 0;
+    c->len = 0;
+    c->in_body = false;
+    w->connects++;
+    if (connect(c->fd, (const sockaddr*)w->addr, sizeof(*w->addr)) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return false;
+    }
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    ev.data.ptr = c;
+    epoll_ctl(w->epollfd, EPOLL_CTL_ADD, c->fd, &ev);
+    return true;
+}
+
+// 关闭连接并重新建立；在途的请求不会再有响应，计为错误（-R时保留计划时间，重连期间的等待计入之后请求的延迟）
+static void reconnect(Worker* w, Conn* c, bool error) {
+    if (error) {
+        w->errors += c->count > 0 ? c->count : 1;
+    }
+    c->count = 0;
+    c->head = 0;
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    if (now_ns() >= w->end_ns) {
+        return;
+    }
+    if (!open_conn(w, c)) {
+        w->errors++;
+    }
+}
+
+static void complete(Worker* w, Conn* c, uint64_t now) {
+    int slot = c->head;
+    c->head = (c->head + 1) % MAX_DEPTH;
+    c->count--;
+    if (now >= w->measure_ns && now < w->end_ns) {
+        w->requests++;
+        w->status[c->status >= 100 && c->status < 600 ? c->status / 100 : 0]++;
+        w->corrected.add(now - c->intended[slot]);
+        w->uncorrected.add(now - c->sent[slot]);
+    }
+}
+
+// 解析缓冲区中的响应：头部必须完整位于缓冲区中，响应体只计数、不保存
+// 返回false表示响应格式错误
+static bool parse_responses(Worker* w, Conn* c, uint64_t now) {
+    int pos = 0;
+    // 没有响应体的响应（如304）在解析完头部后立即完成
+    while (pos < c->len || (c->in_body && c->body_left == 0)) {
+        if (c->in_body) {
+            uint64_t take = std::min<uint64_t>(c->body_left, c->len - pos);
+            c->body_left -= take;
+            pos += take;
+            if (c->body_left > 0) {
+                break;
+            }
+            c->in_body = false;
+            if (c->count == 0) {
+                return false;   // 没有请求对应的响应
+            }
+            complete(w, c, now);
+            if (c->server_close || w->opt->close_mode) {
+                c->len = 0;
+                reconnect(w, c, false);
+                return true;
+            }
+            continue;
+        }
+        char* start = c->buf + pos;
+        char* end = (char*)memmem(start, c->len - pos, "\r\n\r\n", 4);
+        if (!end) {
+            if (pos == 0 && c->len == RECV_BUF) {
+                return false;   // 头部过长
+            }
+            break;
+        }
+        *end = '\0';
+        if (strncmp(start, "HTTP/1.", 7) != 0) {
+            return false;
+        }
+        c->status = atoi(start + 9);
+        c->body_left = 0;
+        c->server_close = false;
+        for (char* line = strstr(start, "\r\n"); line; line = strstr(line, "\r\n")) {
+            line += 2;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                c->body_left = strtoull(line + 15, NULL, 10);
+            } else if (strncasecmp(line, "Connection:", 11) == 0) {
+                c->server_close = strncasecmp(line + 11 + strspn(line + 11, " "), "close", 5) == 0;
+            }
+        }
+        pos = end + 4 - c->buf;
+        c->in_body = true;
+    }
+    memmove(c->buf, c->buf + pos, c->len - pos);
+    c->len -= pos;
+    return true;
+}
+
+static void on_event(Worker* w, Conn* c, uint32_t events) {
+    uint64_t now = now_ns();
+    if (c->connecting) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            reconnect(w, c, true);
+            return;
+        }
+        if (!(events & EPOLLOUT)) {
+            return;
+        }
+        c->connecting = false;
+        fill(w, c, now);
+    }
+    if (events & EPOLLIN) {
+        while (true) {
+            ssize_t n = recv(c->fd, c->buf + c->len, RECV_BUF - c->len, 0);
+            if (n > 0) {
+                if (now >= w->measure_ns) {
+                    w->bytes += n;
+                }
+                c->len += n;
+                uint32_t gen = c->gen;
+                if (!parse_responses(w, c, now_ns())) {
+                    fprintf(stderr, "bad response\n");
+                    reconnect(w, c, true);
+                    return;
+                }
+                if (c->gen != gen || c->fd < 0) {
+                    return;     // 已重新连接或测试已结束
+                }
+                continue;
+            }
+            if (n == 0) {
+                // 对端关闭：有在途的请求时为错误
+                reconnect(w, c, c->count > 0);
+                return;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            reconnect(w, c, true);
+            return;
+        }
+    }
+    fill(w, c, now_ns());
+    if (!flush(c)) {
+        reconnect(w, c, true);
+    }
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    w->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    for (int i = 0; i < w->nconns; i++) {
+        Conn* c = new Conn();
+        c->fd = -1;
+        // 各连接的计划时间错开，避免同时发送
+        c->next_ns = w->start_ns + (w->interval_ns * (w->first_conn + i)) / w->opt->conns;
+        w->conns.push_back(c);
+        if (!open_conn(w, c)) {
+            w->errors++;
+        }
+    }
+    std::vector<epoll_event> events(256);
+    while (true) {
+        uint64_t now = now_ns();
+        if (now >= w->end_ns) {
+            break;
+        }
+        int timeout = (int)((w->end_ns - now) / 1000000) + 1;
+        if (w->interval_ns != 0) {
+            // 等到最早的计划发送时间（毫秒精度，不足1ms时不等待）
+            for (size_t i = 0; i < w->conns.size(); i++) {
+                Conn* c = w->conns[i];
+                if (c->fd < 0 || c->connecting) {
+                    continue;
+                }
+                int t = c->next_ns > now ? (int)((c->next_ns - now) / 1000000) : 0;
+                if (t < timeout) {
+                    timeout = t;
+                }
+            }
+        }
+        int n = epoll_wait(w->epollfd, events.data(), events.size(), timeout);
+        for (int i = 0; i < n; i++) {
+            on_event(w, (Conn*)events[i].data.ptr, events[i].events);
+        }
+        if (w->interval_ns != 0) {
+            now = now_ns();
+            for (size_t i = 0; i < w->conns.size(); i++) {
+                Conn* c = w->conns[i];
+                if (c->fd >= 0 && !c->connecting && c->next_ns <= now) {
+                    fill(w, c, now);
+                    if (!flush(c)) {
+                        reconnect(w, c, true);
+                    }
+                }
+            }
+        }
+        // 连接失败的连接重新尝试
+        for (size_t i = 0; i < w->conns.size(); i++) {
+            if (w->conns[i]->fd < 0) {
+                reconnect(w, w->conns[i], false);
+            }
+        }
+    }
+    for (size_t i = 0; i < w->conns.size(); i++) {
+        if (w->conns[i]->fd >= 0) {
+            close(w->conns[i]->fd);
+        }
+        delete w->conns[i];
+    }
+    close(w->epollfd);
+    return NULL;
+}
+
+// HdrHistogram的copyCorrectedForCoordinatedOmission：补记期望间隔内本应被测量到的请求
+static void correct_omission(const HistogramSnapshot& in, uint64_t interval, HistogramSnapshot* out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < HistogramLayout::BUCKETS; i++) {
+        uint64_t n = in.counts[i];
+        if (n == 0) {
+            continue;
+        }
+        uint64_t v = HistogramLayout::bucket_upper(i);
+        if (v > in.max) {
+            v = in.max;
+        }
+        out->add(v, n);
+        if (interval == 0) {
+            continue;
+        }
+        for (uint64_t missing = v > interval ? v - interval : 0; missing >= interval; missing -= interval) {
+            out->add(missing, n);
+        }
+    }
+}
+
+static void print_latency(FILE* fp, const char* name, const HistogramSnapshot& h) {
+    fprintf(fp, "\"%s\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}", name,
+            h.count ? h.sum / 1e3 / h.count : 0.0, h.quantile(0.5) / 1e3, h.quantile(0.9) / 1e3,
+            h.quantile(0.99) / 1e3, h.quantile(0.999) / 1e3, h.max / 1e3);
+}
+
+int main(int argc, char* argv[]) {
+    Options opt = {"127.0.0.1", 1234, 64, 2, 10, 1, 1, false, 0, NULL, ""};
+    int ch;
+    while ((ch = getopt(argc, argv, "c:t:d:w:p:CR:u:n:")) != -1) {
+        switch (ch) {
+            case 'c': opt.conns = atoi(optarg); break;
+            case 't': opt.threads = atoi(optarg); break;
+            case 'd': opt.duration = atof(optarg); break;
+            case 'w': opt.warmup = atof(optarg); break;
+            case 'p': opt.depth = atoi(optarg); break;
+            case 'C': opt.close_mode = true; break;
+            case 'R': opt.rate = atof(optarg); break;
+            case 'u': opt.url_file = optarg; break;
+            case 'n': opt.name = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind < argc) {
+        static char host[128];
+        snprintf(host, sizeof(host), "%s", argv[optind]);
+        char* colon = strrchr(host, ':');
+        if (colon) {
+            *colon = '\0';
+            opt.port = atoi(colon + 1);
+        }
+        opt.host = host;
+    }
+    if (opt.conns < 1 || opt.threads < 1 || opt.depth < 1 || opt.depth > MAX_DEPTH || opt.duration <= 0) {
+        usage(argv[0]);
+    }
+    if (opt.threads > opt.conns) {
+        opt.threads = opt.conns;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.host, &addr.sin_addr) != 1) {
+        struct hostent* he = gethostbyname(opt.host);
+        if (!he) {
+            fprintf(stderr, "unknown host %s\n", opt.host);
+            return 1;
+        }
+        memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+    }
+    UrlMix mix;
+    if (!load_urls(opt, &mix)) {
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    uint64_t measure = start + (uint64_t)(opt.warmup * 1e9);
+    uint64_t end = measure + (uint64_t)(opt.duration * 1e9);
+    uint64_t interval = opt.rate > 0 ? (uint64_t)(1e9 * opt.conns / opt.rate) : 0;
+    std::vector<Worker*> workers;
+    std::vector<pthread_t> tids(opt.threads);
+    int next_conn = 0;
+    for (int i = 0; i < opt.threads; i++) {
+        Worker* w = new Worker();
+        w->opt = &opt;
+        w->mix = &mix;
+        w->addr = &addr;
+        w->first_conn = next_conn;
+        w->nconns = opt.conns / opt.threads + (i < opt.conns % opt.threads ? 1 : 0);
+        next_conn += w->nconns;
+        w->start_ns = start;
+        w->measure_ns = measure;
+        w->end_ns = end;
+        w->interval_ns = interval;
+        w->rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+        workers.push_back(w);
+        pthread_create(&tids[i], NULL, worker_main, w);
+    }
+
+    uint64_t requests = 0, bytes = 0, errors = 0, connects = 0;
+    uint64_t status[6] = {0};
+    HistogramSnapshot* raw = new HistogramSnapshot();
+    HistogramSnapshot* uncorrected = new HistogramSnapshot();
+    for (int i = 0; i < opt.threads; i++) {
+        pthread_join(tids[i], NULL);
+        Worker* w = workers[i];
+        requests += w->requests;
+        bytes += w->bytes;
+        errors += w->errors;
+        connects += w->connects;
+        for (int s = 0; s < 6; s++) {
+            status[s] += w->status[s];
+        }
+        raw->merge(w->corrected);
+        uncorrected->merge(w->uncorrected);
+        delete w;
+    }
+
+    HistogramSnapshot* corrected = raw;
+    if (interval == 0 && requests > 0) {
+        // 闭环：每个在途请求位置发出请求的平均间隔
+        uint64_t slots = (uint64_t)opt.conns * (opt.close_mode ? 1 : opt.depth);
+        uint64_t expected = (uint64_t)(opt.duration * 1e9 * slots / requests);
+        corrected = new HistogramSnapshot();
+        correct_omission(*raw, expected, corrected);
+    }
+
+    double secs = opt.duration;
+    fprintf(stderr, "%s%s%d conns, %d threads, depth %d, %s, %.0fs: %.0f req/s, %.2f MB/s, %llu errors\n",
+            opt.name, opt.name[0] ? ": " : "", opt.conns, opt.threads, opt.depth,
+            opt.close_mode ? "close" : "keep-alive", secs, requests / secs, bytes / secs / 1e6,
+            (unsigned long long)errors);
+    fprintf(stderr, "  latency (us, corrected)   p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+            corrected->quantile(0.5) / 1e3, corrected->quantile(0.99) / 1e3,
+            corrected->quantile(0.999) / 1e3, corrected->max / 1e3);
+    fprintf(stderr, "  latency (us, uncorrected) p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+            uncorrected->quantile(0.5) / 1e3, uncorrected->quantile(0.99) / 1e3,
+            uncorrected->quantile(0.999) / 1e3, uncorrected->max / 1e3);
+
+    printf("{\"name\":\"%s\",\"connections\":%d,\"threads\":%d,\"pipeline\":%d,\"keepalive\":%s,"
+           "\"rate\":%.0f,\"duration_s\":%.3f,\"requests\":%llu,\"errors\":%llu,\"connects\":%llu,"
+           "\"rps\":%.1f,\"mbps\":%.3f,\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,"
+           "\"5xx\":%llu,\"other\":%llu},",
+           opt.name, opt.conns, opt.threads, opt.close_mode ? 1 : opt.depth, opt.close_mode ? "false" : "true",
+           opt.rate, secs, (unsigned long long)requests, (unsigned long long)errors,
+           (unsigned long long)connects, requests / secs, bytes / secs / 1e6,
+           (unsigned long long)status[1], (unsigned long long)status[2], (unsigned long long)status[3],
+           (unsigned long long)status[4], (unsigned long long)status[5], (unsigned long long)status[0]);
+    print_latency(stdout, "latency_us", *corrected);
+    printf(",");
+    print_latency(stdout, "latency_uncorrected_us", *uncorrected);
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,272 @@
+// 请求解析微基准：逐字节状态机（HTTPConn原先的parse_line + strpbrk/strncasecmp）与http_scan各实现的对比
+// 用法：bin/parse_bench [迭代次数]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include "http_scan.h"
+
+// 典型浏览器/工具发出的请求头
+static const char* CHROME_REQ =
+    "GET /static/js/app.3f9a1c.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/products/list?page=2&sort=price\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+    "Cookie: _ga=GA1.2.1234567890.1700000000; session=8f14e45fceea167a5a36dedd4bea2543; theme=dark\r\n"
+    "\r\n";
+
+static const char* FIREFOX_REQ =
+    "GET /index.html HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "\r\n";
+
+static const char* CURL_REQ =
+    "GET /small.css HTTP/1.1\r\n"
+    "Host: 127.0.0.1:1234\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n";
+
+// 解析结果，用于校验两种解析方式一致，同时防止编译器把解析过程优化掉
+struct Result {
+    const char* url;
+    const char* host;
+    bool linger;
+    long content_length;
+    int lines;
+};
+
+// ---------------- 原先的逐字节状态机 ----------------
+
+static int legacy_parse_line(char* buf, int& cur, int end) {
+    while (cur < end) {
+        char temp = buf[cur];
+        if (temp == '\r') {
+            if (cur + 1 == end) {
+                return 1;
+            } else if (buf[cur + 1] == '\n') {
+                buf[cur++] = 0;
+                buf[cur++] = 0;
+                return 0;
+            }
+            return 2;
+        } else if (temp == '\n') {
+            if (cur > 1 && buf[cur - 1] == '\r') {
+                buf[cur - 1] = 0;
+                buf[cur++] = 0;
+                return 0;
+            }
+            return 2;
+        }
+        cur++;
+    }
+    return 1;
+}
+
+static bool legacy_parse(char* buf, int len, Result* r) {
+    int cur = 0;
+    int start = 0;
+    bool request_line = true;
+    memset(r, 0, sizeof(*r));
+    while (legacy_parse_line(buf, cur, len) == 0) {
+        char* text = buf + start;
+        start = cur;
+        if (request_line) {
+            char* url = strpbrk(text, " \t");
+            if (!url) {
+                return false;
+            }
+            *url++ = '\0';
+            url += strspn(url, " \t");
+            char* version = strpbrk(url, " \t");
+            if (!version) {
+                return false;
+            }
+            *version++ = '\0';
+            r->url = url;
+            request_line = false;
+            continue;
+        }
+        if (text[0] == '\0') {
+            return true;
+        }
+        r->lines++;
+        if (strncasecmp(text, "Host:", 5) == 0) {
+            text += 5;
+            text += strspn(text, " \t");
+            r->host = text;
+        } else if (strncasecmp(text, "Connection:", 11) == 0) {
+            text += 11;
+            text += strspn(text, " \t");
+            r->linger = strcasecmp(text, "keep-alive") == 0;
+        } else if (strncasecmp(text, "Content-Length:", 15) == 0) {
+            text += 15;
+            text += strspn(text, " \t");
+            r->content_length = atol(text);
+        }
+    }
+    return false;
+}
+
+// ---------------- http_scan ----------------
+
+static bool scan_parse(char* buf, int len, Result* r) {
+    memset(r, 0, sizeof(*r));
+    char* end = (char*)scan_eol(buf, buf + len);
+    if (end + 1 >= buf + len || end[0] != '\r' || end[1] != '\n') {
+        return false;
+    }
+    end[0] = end[1] = '\0';
+    char* url = (char*)scan_space(buf, end);
+    if (url == end) {
+        return false;
+    }
+    *url++ = '\0';
+    url += strspn(url, " \t");
+    char* version = (char*)scan_space(url, end);
+    if (version == end) {
+        return false;
+    }
+    *version = '\0';
+    r->url = url;
+
+    char* base = end + 2;
+    HeaderSpan spans[64];
+    size_t consumed;
+    int n = scan_headers(base, buf + len - base, spans, 64, &consumed);
+    if (n < 0) {
+        return false;
+    }
+    r->lines = n;
+    for (int i = 0; i < n; i++) {
+        const HeaderSpan& s = spans[i];
+        if (s.value_off < 0) {
+            continue;
+        }
+        char* value = base + s.value_off;
+        value[s.value_len] = '\0';
+        const char* name = base + s.name_off;
+        switch (s.name_len) {
+            case 4:
+                if (strncasecmp(name, "Host", 4) == 0) {
+                    r->host = value;
+                }
+                break;
+            case 10:
+                if (strncasecmp(name, "Connection", 10) == 0) {
+                    r->linger = strcasecmp(value, "keep-alive") == 0;
+                }
+                break;
+            case 14:
+                if (strncasecmp(name, "Content-Length", 14) == 0) {
+                    r->content_length = atol(value);
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef bool (*ParseFn)(char*, int, Result*);
+
+static double run(ParseFn fn, const std::string& req, long iters) {
+    std::vector<char> buf(req.size());
+    int len = req.size();
+    Result r;
+    long sink = 0;
+    // 预热
+    for (int i = 0; i < 1000; i++) {
+        memcpy(buf.data(), req.data(), len);
+        fn(buf.data(), len, &r);
+    }
+    double t0 = now_sec();
+    for (long i = 0; i < iters; i++) {
+        memcpy(buf.data(), req.data(), len);
+        sink += fn(buf.data(), len, &r);
+        sink += r.lines;
+    }
+    double t1 = now_sec();
+    if (sink == 0) {
+        printf("unexpected: parse failed\n");
+    }
+    return (t1 - t0) * 1e9 / iters;
+}
+
+// 解析一次并把结果转成字符串，用于比较不同解析方式的结果
+static std::string describe(ParseFn fn, const std::string& req) {
+    std::vector<char> buf(req.begin(), req.end());
+    Result r;
+    if (!fn(buf.data(), buf.size(), &r)) {
+        return "parse failed";
+    }
+    char out[512];
+    snprintf(out, sizeof(out), "url=%s host=%s linger=%d length=%ld lines=%d",
+             r.url, r.host ? r.host : "", r.linger, r.content_length, r.lines);
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    long iters = argc > 1 ? atol(argv[1]) : 2000000;
+    struct {
+        const char* name;
+        const char* req;
+    } cases[] = {
+        { "chrome", CHROME_REQ },
+        { "firefox", FIREFOX_REQ },
+        { "curl", CURL_REQ },
+    };
+    ScanImpl impls[] = { SCAN_SCALAR, SCAN_SSE42, SCAN_AVX2 };
+
+    printf("%-8s %6s %-8s %10s %8s\n", "request", "bytes", "parser", "ns/req", "speedup");
+    int failed = 0;
+    for (auto& c : cases) {
+        std::string req = c.req;
+        std::string expect = describe(legacy_parse, req);
+        double legacy = run(legacy_parse, req, iters);
+        printf("%-8s %6zu %-8s %10.1f %8s\n", c.name, req.size(), "legacy", legacy, "1.00x");
+        for (ScanImpl impl : impls) {
+            if (!scan_select(impl)) {
+                continue;
+            }
+            std::string got = describe(scan_parse, req);
+            if (got != expect) {
+                printf("  MISMATCH (%s): %s\n  expected: %s\n", scan_impl_name(), got.c_str(), expect.c_str());
+                failed = 1;
+            }
+            double t = run(scan_parse, req, iters);
+            printf("%-8s %6zu %-8s %10.1f %7.2fx\n", c.name, req.size(), scan_impl_name(), t, legacy / t);
+        }
+    }
+    return failed;
+}
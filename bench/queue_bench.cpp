@@ -0,0 +1,68 @@
+// 线程池队列微基准：thread_pool.h中各队列实现（互斥锁+std::list、SPSC轮询、MPMC、工作窃取、boost::lockfree）的对比
+// 吞吐：1..N个生产者线程尽快append，1..N个工作线程处理空任务；交接延迟：单个生产者逐个提交，测量从append到process开始的时间
+// 每项运行多次取中位数
+// 用法：bin/queue_bench [每轮任务数] [最大线程数]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "queue_bench.h"
+
+static std::vector<QueueVariant>& variants() {
+    static std::vector<QueueVariant> v;
+    return v;
+}
+
+void register_queue_variant(const QueueVariant& v) {
+    variants().push_back(v);
+}
+
+static const int REPEAT = 5;
+static const int HANDOFF_SAMPLES = 2000;
+
+// 输出顺序与thread_pool.h中的说明一致，与链接顺序无关
+static const char* const ORDER[] = {"list", "spsc", "mpmc", "ws", "boost"};
+
+int main(int argc, char* argv[]) {
+    long tasks = argc > 1 ? atol(argv[1]) : 200000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 4;
+    std::vector<int> counts;
+    for (int n = 1; n <= max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+
+    printf("%-6s %5s %5s %10s %12s %12s\n", "queue", "prod", "cons", "Mtask/s", "handoff p50", "handoff p99");
+    for (const char* name : ORDER) {
+        for (const QueueVariant& v : variants()) {
+            if (strcmp(v.name, name) != 0) {
+                continue;
+            }
+            if (!v.throughput) {
+                printf("%-6s (unavailable)\n", v.name);
+                continue;
+            }
+            for (int c : counts) {
+                QueueResult lat;
+                v.handoff(c, HANDOFF_SAMPLES, &lat);
+                for (int p : counts) {
+                    if (p > 1 && !v.multi_producer) {
+                        continue;
+                    }
+                    std::vector<double> secs;
+                    v.throughput(p, c, tasks / 10);     // 预热
+                    for (int r = 0; r < REPEAT; r++) {
+                        secs.push_back(v.throughput(p, c, tasks));
+                    }
+                    std::sort(secs.begin(), secs.end());
+                    double mops = tasks / secs[REPEAT / 2] / 1e6;
+                    printf("%-6s %5d %5d %10.2f %10.0fns %10.0fns\n", v.name, p, c, mops,
+                           lat.handoff_p50_ns, lat.handoff_p99_ns);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef QUEUE_BENCH_HEADER
+#define QUEUE_BENCH_HEADER
+
+// 线程池队列微基准的公共部分
+// ThreadPool的队列实现由thread_pool.h中的#define选择，同一个编译单元只能得到一种实现，
+// 所以queue_variant.cpp由Makefile以不同的-D选项编译多次，每个目标文件在启动时把自己登记到这里
+
+#include <stdint.h>
+
+struct QueueResult {
+    double mops;            // 吞吐：每秒完成的任务数（百万）
+    double handoff_p50_ns;  // 交接延迟：append到工作线程开始process的时间
+    double handoff_p99_ns;
+};
+
+struct QueueVariant {
+    const char* name;
+    bool multi_producer;    // append是否允许多个线程同时调用
+    // 吞吐：producers个线程共提交tasks个任务，consumers个工作线程处理，返回耗时（秒）
+    double (*throughput)(int producers, int consumers, long tasks);
+    // 交接延迟：单个生产者逐个提交samples个任务，每个任务处理完才提交下一个
+    void (*handoff)(int consumers, int samples, QueueResult* out);
+};
+
+void register_queue_variant(const QueueVariant& v);
+
+#endif
@@ -0,0 +1,142 @@
+// ThreadPool的一种队列实现，由Makefile以不同的-D选项（USE_LOCKFREE_QUEUE等）和QUEUE_VARIANT名字编译多次
+// 任务类型位于匿名命名空间中，各目标文件中的ThreadPool<Task>是不同的类型，不会互相冲突
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
+#if defined(USE_BOOST_LOCKFREE_QUEUE) && !__has_include("boost/lockfree/queue.hpp")
+#define QUEUE_VARIANT_UNAVAILABLE
+#undef USE_BOOST_LOCKFREE_QUEUE
+#endif
+
+#include "thread_pool.h"
+#include "queue_bench.h"
+
+#define STR2(x) #x
+#define STR(x) STR2(x)
+
+namespace {
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+std::atomic<long> g_done(0);
+std::atomic<uint64_t> g_started_ns(0);
+
+struct Task {
+    uint64_t enqueued_ns;
+    void process() {
+        if (enqueued_ns) {
+            g_started_ns.store(now_ns(), std::memory_order_relaxed);
+        }
+        g_done.fetch_add(1, std::memory_order_release);
+    }
+};
+
+// 工作线程不会退出，每种线程数只创建一个线程池（ThreadPool创建线程时的输出被丢弃）
+ThreadPool<Task>* pool_for(int consumers) {
+    static std::map<int, ThreadPool<Task>*> pools;
+    ThreadPool<Task>*& pool = pools[consumers];
+    if (!pool) {
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        pool = new ThreadPool<Task>(consumers, 4096);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(null_fd);
+        close(saved);
+    }
+    return pool;
+}
+
+void wait_done(long target) {
+    while (g_done.load(std::memory_order_acquire) < target) {
+        sched_yield();
+    }
+}
+
+double throughput(int producers, int consumers, long tasks) {
+    ThreadPool<Task>* pool = pool_for(consumers);
+    static Task task = {0};
+    g_done.store(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        long n = tasks / producers + (p < tasks % producers ? 1 : 0);
+        threads.push_back(std::thread([pool, n, &go]() {
+            while (!go.load(std::memory_order_acquire)) {
+                sched_yield();
+            }
+            for (long i = 0; i < n; i++) {
+                while (!pool->append(&task)) {
+                    sched_yield();  // 队列已满
+                }
+            }
+        }));
+    }
+    uint64_t t0 = now_ns();
+    go.store(true, std::memory_order_release);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    wait_done(tasks);
+    return (now_ns() - t0) / 1e9;
+}
+
+void handoff(int consumers, int samples, QueueResult* out) {
+    ThreadPool<Task>* pool = pool_for(consumers);
+    std::vector<uint64_t> lat;
+    lat.reserve(samples);
+    Task task = {0};
+    g_done.store(0);
+    for (int i = 0; i < samples; i++) {
+        task.enqueued_ns = now_ns();
+        while (!pool->append(&task)) {
+            sched_yield();
+        }
+        wait_done(i + 1);
+        lat.push_back(g_started_ns.load(std::memory_order_relaxed) - task.enqueued_ns);
+    }
+    std::sort(lat.begin(), lat.end());
+    out->handoff_p50_ns = lat[lat.size() / 2];
+    out->handoff_p99_ns = lat[lat.size() * 99 / 100];
+}
+
+struct Registrar {
+    Registrar() {
+        QueueVariant v;
+        v.name = STR(QUEUE_VARIANT);
+#ifdef QUEUE_VARIANT_UNAVAILABLE
+        // 依赖的库不存在，只登记名字
+        (void)&throughput;
+        (void)&handoff;
+        v.throughput = NULL;
+        v.handoff = NULL;
+#else
+        v.throughput = throughput;
+        v.handoff = handoff;
+#endif
+        // 多个SPSC队列的轮询分发：append本身不是线程安全的
+#ifdef USE_LOCKFREE_QUEUE
+        v.multi_producer = false;
+#else
+        v.multi_producer = true;
+#endif
+        register_queue_variant(v);
+    }
+} registrar;
+
+}
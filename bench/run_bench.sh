@@ -0,0 +1,135 @@
+#!/bin/bash
+# 压测脚本（make bench）：生成测试用的网站目录，启动bin/server，用bin/loadgen依次运行各个场景，
+# 把结果汇总为一个JSON文件，便于在不同提交之间比较
+#
+# 环境变量：
+#   BENCH_PORT      服务器端口（默认18080）
+#   BENCH_DURATION  每个场景的统计时长，秒（默认10）
+#   BENCH_WARMUP    每个场景的预热时长，秒（默认1）
+#   BENCH_CONNS     连接数（默认64）
+#   BENCH_THREADS   loadgen线程数（默认2）
+#   BENCH_RATE      固定速率场景的目标请求速率（默认20000）
+#   BENCH_SERVER_CONF  追加到服务器配置文件中的内容（如"worker_threads = 4"）
+#   BENCH_OUT       结果文件（默认bin/bench-<commit>.json）
+
+set -e
+cd "$(dirname "$0")/.."
+
+PORT=${BENCH_PORT:-18080}
+DURATION=${BENCH_DURATION:-10}
+WARMUP=${BENCH_WARMUP:-1}
+CONNS=${BENCH_CONNS:-64}
+THREADS=${BENCH_THREADS:-2}
+RATE=${BENCH_RATE:-20000}
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT=${BENCH_OUT:-bin/bench-$COMMIT.json}
+
+WORK=$(mktemp -d)
+SERVER_PID=
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill -INT "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# 网站目录：不同大小的文件，覆盖内容缓存、mmap/sendfile和大文件发送
+ROOT=$WORK/www
+mkdir -p "$ROOT"
+head -c 512 /dev/urandom | base64 > "$ROOT/index.html"
+head -c 4096 /dev/urandom > "$ROOT/4k.bin"
+head -c 16384 /dev/urandom > "$ROOT/16k.bin"
+head -c 131072 /dev/urandom > "$ROOT/128k.bin"
+head -c 1048576 /dev/urandom > "$ROOT/1m.bin"
+
+# URL组合：大部分是小文件
+cat > "$WORK/mix.txt" <<EOF
+# 权重 URL
+50 /index.html
+25 /4k.bin
+15 /16k.bin
+8 /128k.bin
+2 /1m.bin
+EOF
+echo "1 /index.html" > "$WORK/small.txt"
+echo "1 /1m.bin" > "$WORK/large.txt"
+
+cat > "$WORK/server.conf" <<EOF
+doc_root = $ROOT
+enable_stats = yes
+${BENCH_SERVER_CONF:-}
+EOF
+
+bin/server -c "$WORK/server.conf" "$PORT" > "$WORK/server.log" 2>&1 &
+SERVER_PID=$!
+for _ in $(seq 50); do
+    if (exec 3<>/dev/tcp/127.0.0.1/"$PORT") 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+
+# 场景：名字 loadgen参数
+SCENARIOS=(
+    "small_keepalive    -u $WORK/small.txt"
+    "small_pipeline8    -u $WORK/small.txt -p 8"
+    "small_close        -u $WORK/small.txt -C"
+    "mix_keepalive      -u $WORK/mix.txt"
+    "large_keepalive    -u $WORK/large.txt"
+    "mix_fixed_rate     -u $WORK/mix.txt -R $RATE"
+)
+
+# 发送策略的效果：每个响应的TCP报文段数（/proc/net/snmp中的OutSegs，回环上包括loadgen发出的请求和ACK），
+# 以及场景期间TCP套接字内存的峰值（/proc/net/sockstat，单位为页，同样包括两端）
+tcp_out_segs() {
+    awk '/^Tcp:/ { if (!h) { for (i = 1; i <= NF; i++) if ($i == "OutSegs") c = i; h = 1 } else print $c }' /proc/net/snmp
+}
+tcp_mem_pages() {
+    awk '/^TCP:/ { for (i = 2; i < NF; i++) if ($i == "mem") print $(i + 1) }' /proc/net/sockstat
+}
+# 服务器发出的响应总数（/__stats中各状态码之和），包括预热期间的响应，与OutSegs的统计范围一致
+server_responses() {
+    curl -s "http://127.0.0.1:$PORT/__stats" | grep -o '"responses":{[^}]*}' | grep -o ':[0-9]*' | tr -d : |
+        awk '{ s += $1 } END { print s + 0 }'
+}
+
+RESULTS=()
+for s in "${SCENARIOS[@]}"; do
+    read -r name args <<< "$s"
+    segs0=$(tcp_out_segs)
+    resp0=$(server_responses)
+    # 后台每100ms采样一次套接字内存，记录最大值
+    (
+        max=0
+        while true; do
+            v=$(tcp_mem_pages)
+            [ "$v" -gt "$max" ] && max=$v && echo "$max" > "$WORK/mem_max"
+            sleep 0.1
+        done
+    ) &
+    SAMPLER_PID=$!
+    echo 0 > "$WORK/mem_max"
+    # shellcheck disable=SC2086
+    result=$(bin/loadgen -n "$name" -c "$CONNS" -t "$THREADS" -d "$DURATION" -w "$WARMUP" $args 127.0.0.1:"$PORT")
+    kill "$SAMPLER_PID" 2>/dev/null || true
+    wait "$SAMPLER_PID" 2>/dev/null || true
+    segs=$(($(tcp_out_segs) - segs0))
+    resp=$(($(server_responses) - resp0))
+    tcp=$(awk -v s="$segs" -v r="$resp" -v m="$(cat "$WORK/mem_max")" \
+        'BEGIN { printf "\"tcp\":{\"out_segs_per_response\":%.2f,\"mem_pages_max\":%d}", (r > 0 ? s / r : 0), m }')
+    # 追加到loadgen输出的JSON对象末尾
+    RESULTS+=("${result%\}},$tcp}")
+done
+
+{
+    printf '{"commit":"%s","date":"%s","host":"%s","cpus":%d,"results":[\n' \
+        "$COMMIT" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$(nproc)"
+    for i in "${!RESULTS[@]}"; do
+        [ "$i" -gt 0 ] && printf ',\n'
+        printf '%s' "${RESULTS[$i]}"
+    done
+    printf '\n]}\n'
+} > "$OUT"
+echo "results written to $OUT" >&2
@@ -0,0 +1,106 @@
+#ifndef ACCESS_LOG_HEADER
+#define ACCESS_LOG_HEADER
+
+// 异步访问日志
+// 原理：在请求路径上直接fprintf时，所有reactor和工作线程都要争抢同一个stdio锁，还要在请求路径上格式化文本。
+//  这里每个线程第一次记录时注册一个自己的SPSC环形队列（LockFreeQueue_SPSC），请求路径上只把一条定长的二进制记录
+//  复制进队列；后台线程轮流取出各队列中的记录，成批格式化后用大块write写入文件。
+//  队列满时记录被丢弃并计数（/__stats中的access_log_dropped），请求路径永远不会因日志阻塞。
+//  文件格式：文本（类似Common Log Format，末尾附加处理耗时），或者紧凑的二进制格式
+//  （AccessLogHeader之后依次是AccessRecord，本机字节序），由bin/access_log_decode转换为文本。
+//  记录按线程成批写出，不同线程的记录之间不保证按时间排序。
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "locker.h"
+#include "lockfree.h"
+#include "metrics.h"
+
+// 一条访问记录，定长128字节
+struct AccessRecord {
+    static const int URL_MAX = 96;
+    uint64_t time_us;       // 请求处理完成的时间（UNIX时间，微秒）
+    uint64_t bytes;         // 响应的字节数（头部+响应体）
+    uint32_t client_addr;   // 网络字节序
+    uint32_t duration_us;   // 解析请求到生成响应的耗时（不含发送）
+    uint16_t client_port;   // 网络字节序
+    uint16_t status;
+    uint16_t url_len;       // URL的实际长度，超过URL_MAX时url中只保存前URL_MAX字节
+    uint8_t method;         // HTTPConn::METHOD
+    uint8_t version;        // HTTPConn::HTTP_VERSION
+    char url[URL_MAX];      // 不以'\0'结尾，无法解析出URL时url_len为0
+};
+
+// 二进制日志文件的开头（文件为空时写入，之后追加记录）
+struct AccessLogHeader {
+    char magic[8];          // ACCESS_LOG_MAGIC
+    uint32_t version;
+    uint32_t record_size;   // sizeof(AccessRecord)
+};
+static const char ACCESS_LOG_MAGIC[8] = { 'H', 'T', 'T', 'P', 'A', 'L', 'O', 'G' };
+static const uint32_t ACCESS_LOG_VERSION = 1;
+
+// 把一条记录格式化为一行文本（含'\n'）写到buf，返回长度；空间不够时截断
+size_t format_access_record(const AccessRecord& r, char* buf, size_t size);
+
+class AccessLog {
+public:
+    AccessLog() {}
+    AccessLog(const AccessLog&) = delete;
+    AccessLog& operator=(const AccessLog&) = delete;
+
+    // 打开日志文件（追加）并启动后台线程，ring_size为每个线程的队列容量（条）
+    bool open(const char* path, bool binary, int ring_size);
+    // 停止后台线程，写出队列中剩余的记录
+    void close();
+    // 日志轮转：后台线程在下一轮重新打开文件
+    void reopen() { m_reopen.store(true, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled; }
+
+    // 请求路径上调用：只复制记录，队列满时丢弃
+    void log(const AccessRecord& r) {
+        if (__builtin_expect(t_ring == NULL, 0)) {
+            t_ring = register_thread();
+        }
+        if (!t_ring->push(r)) {
+            metrics.add(Metrics::ACCESS_LOG_DROPS);
+        }
+    }
+
+private:
+    typedef LockFreeQueue_SPSC<AccessRecord> Ring;
+    // 后台线程没有取到记录时的休眠时间，也是记录写入文件的最大延迟
+    static const int IDLE_SLEEP_US = 20000;
+    // 格式化缓冲区的大小，满时写出
+    static const size_t WRITE_BUF_SIZE = 256 * 1024;
+
+    Ring* register_thread();
+    static void* writer(void* arg);
+    void run();
+    // 取出所有队列中的记录写入文件，返回记录是否很多（写满过缓冲区或某个队列超过一半），这时应立即开始下一轮
+    bool drain(char* buf);
+    bool open_file();
+    void write_out(const char* buf, size_t len);
+
+    static __thread Ring* t_ring;
+    bool m_enabled{false};
+    bool m_binary{false};
+    int m_ring_size{0};
+    char m_path[256];
+    int m_fd{-1};
+    pthread_t m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_reopen{false};
+    // 已注册的队列，不释放（线程退出或close之后仍可能有线程入队）
+    locker m_lock;
+    std::vector<Ring*> m_rings;
+    std::vector<Ring*> m_snapshot;  // 后台线程每一轮复制的队列列表
+};
+
+extern AccessLog access_log;
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef AFFINITY_HEADER
+#define AFFINITY_HEADER
+
+// CPU亲和性与NUMA放置
+// 原理：线程默认可以在任意CPU（以及任意NUMA节点）之间迁移，reactor、工作线程与它们使用的连接对象、缓冲区
+//  可能位于不同的节点上，每次访问都要跨节点。这里提供把线程绑定到指定CPU、查询CPU所在节点，
+//  以及让一段尚未分配物理页的内存优先从指定节点分配（mbind，MPOL_PREFERRED）的函数。
+//  节点信息读取自/sys/devices/system，不依赖libnuma；无法确定时（非NUMA内核、容器中没有sysfs）返回-1或false，
+//  调用者忽略即可，不影响正确性。
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// 解析CPU列表，格式与taskset -c相同，如"0-3,8,10-11"，结果按出现顺序排列；空串得到空列表
+bool parse_cpu_list(const char* text, std::vector<int>& cpus);
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// 把线程绑定到cpus中的CPU上
+bool pin_thread(pthread_t thread, const std::vector<int>& cpus);
+
+// CPU所在的NUMA节点，无法确定时返回-1
+int cpu_node(int cpu);
+// NUMA节点上的所有CPU
+bool node_cpus(int node, std::vector<int>& cpus);
+
+// [addr, addr + len)中之后第一次被访问的页优先从node分配（已分配的页不移动），addr需按页对齐
+bool prefer_node(void* addr, size_t len, int node);
+
+#endif
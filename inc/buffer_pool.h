@@ -0,0 +1,65 @@
+#ifndef BUFFER_POOL_HEADER
+#define BUFFER_POOL_HEADER
+
+// 连接缓冲区的slab内存池
+// 原理：连接只在请求处理期间才需要读写缓冲区，空闲的keep-alive连接不应长期占用它们。
+//  内存池按2的幂划分若干大小等级（1KB ~ 64KB），每个等级维护一个空闲链表（链表指针直接存放在空闲块的开头），
+//  空闲链表为空时一次从系统申请一个slab并切分为多个块。块归还后留在池中复用，不还给系统。
+//  每个sub reactor拥有一个内存池，连接在该reactor和线程池之间传递，所以用一把锁保护；
+//  同一个池只会被一个reactor及处理其连接的工作线程使用，竞争很小。
+//  slab使用mmap分配，只有真正被使用的页才会占用物理内存，并且由第一次使用它的线程（通常是reactor自身）触发分配；
+//  设置了NUMA节点时，切分前先用mbind指定节点，工作线程触发的分配也落在reactor所在的节点上。
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "locker.h"
+
+class BufferPool {
+public:
+    static const int MIN_SHIFT = 10;        // 最小块1KB
+    static const int NUM_CLASSES = 7;       // 1KB, 2KB, ..., 64KB
+    static const size_t SLAB_SIZE = 64 * 1024;
+
+    struct Stats {
+        size_t slab_bytes;      // 已向系统申请的内存
+        size_t in_use_bytes;    // 正在被连接使用的内存
+    };
+
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    static size_t min_size() {
+        return (size_t)1 << MIN_SHIFT;
+    }
+    static size_t max_size() {
+        return (size_t)1 << (MIN_SHIFT + NUM_CLASSES - 1);
+    }
+    // 申请一个size字节的块，size必须是min_size()~max_size()之间的2的幂，失败返回NULL
+    char* alloc(size_t size);
+    // 归还块，size必须与申请时一致
+    void free(char* buf, size_t size);
+    // 之后申请的slab优先从NUMA节点node分配（所属reactor所在的节点），-1表示不指定
+    void set_node(int node) { m_node = node; }
+
+    Stats stats();
+
+private:
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+    static int class_of(size_t size);
+    bool refill(int cls);
+
+    locker m_lock;
+    FreeChunk* m_free[NUM_CLASSES];
+    std::vector<void*> m_slabs;
+    size_t m_slab_bytes;
+    size_t m_in_use_bytes;
+    int m_node;
+};
+
+#endif
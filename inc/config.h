@@ -2,18 +2,55 @@
 #define CONFIG_HEADER
 
 #include <iostream>
+#include <atomic>
 #include <string.h>
 
+// X(类型, 名字, 是否可以在运行时重新加载)
+// 可重新加载的成员只影响之后的请求/事件循环，SIGHUP时立即生效；其余成员决定线程、套接字、缓存等结构，修改后需要重启
 #define CONFIG_MEMBERS \
-    X(int,    sub_reactors)       \
-    X(int,    worker_threads)     \
-    X(bool,   use_sendfile)       \
-    X(int,    listen_port)        \
-    X_ARRAY(char,   listen_intf, 80)
+    X(int,    sub_reactors,       false)  \
+    X(int,    worker_threads,     false)  \
+    X(int,    max_requests,       false)  \
+    X(bool,   use_sendfile,       true)   \
+    X(bool,   run_to_completion,  true)   \
+    X(int,    max_request_size,   true)   \
+    X(int,    read_buffer_size,   true)   \
+    X(int,    write_buffer_size,  true)   \
+    X(int,    pipeline_depth,     true)   \
+    X(int,    max_events,         true)   \
+    X(int,    header_timeout,     true)   \
+    X(int,    keepalive_timeout,  true)   \
+    X(int,    write_timeout,      true)   \
+    X(int,    write_budget,       true)   \
+    X(int,    listen_port,        false)  \
+    X(int,    listen_backlog,     true)   \
+    X(bool,   tcp_nodelay,        true)   \
+    X(int,    tcp_notsent_lowat,  true)   \
+    X(int,    send_buffer_size,   false)  \
+    X(bool,   reuseport,          false)  \
+    X(bool,   reuseport_cbpf,     false)  \
+    X(bool,   use_io_uring,       false)  \
+    X(bool,   use_file_cache,     false)  \
+    X(int,    file_cache_shards,  false)  \
+    X(int,    file_cache_entries, false)  \
+    X(int,    file_cache_ttl,     false)  \
+    X(bool,   use_content_cache,  false)  \
+    X(int,    content_cache_max_file, false) \
+    X(int,    content_cache_size, false)  \
+    X(bool,   enable_stats,       true)   \
+    X(bool,   colocate_workers,   false)  \
+    X(bool,   access_log_binary,  false)  \
+    X(int,    access_log_ring,    false)  \
+    X_ARRAY(char,   listen_intf, 80,  false) \
+    X_ARRAY(char,   doc_root,    200, false) \
+    X_ARRAY(char,   access_log,  200, false) \
+    X_ARRAY(char,   main_reactor_cpus, 128, false) \
+    X_ARRAY(char,   sub_reactor_cpus,  128, false) \
+    X_ARRAY(char,   worker_cpus,       128, false)
 
 struct Config {
-    #define X(type, name) type name;
-    #define X_ARRAY(type, name, size) type name[size];
+    #define X(type, name, live) type name;
+    #define X_ARRAY(type, name, size, live) type name[size];
     CONFIG_MEMBERS
     #undef X
     #undef X_ARRAY
@@ -21,10 +58,10 @@ struct Config {
     void print() const {
         std::cout << "Configure:\n";
         // 打印普通成员
-        #define X(type, name) \
+        #define X(type, name, live) \
             std::cout << #name << ": " << name << '\n';
         // 打印数组成员，直接输出名称和内容
-        #define X_ARRAY(type, name, size) \
+        #define X_ARRAY(type, name, size, live) \
             std::cout << #name << ": \"" << name << "\"\n";
         CONFIG_MEMBERS
         #undef X
@@ -32,8 +69,23 @@ struct Config {
     }
 
     Config();
-    void load_from(const char* config_path);
+    // 读取"key = value"格式的配置文件（#开始的部分为注释），覆盖文件中出现的成员
+    // 文件无法打开、有无法识别的行或者数值超出范围时返回false，错误信息输出到stderr
+    bool load_from(const char* config_path);
     void init_default();
 };
 
-#endif
\ No newline at end of file
+// 启动时的配置（默认值、配置文件、命令行参数），启动完成后不再修改
+extern Config cfg;
+
+// 当前生效的配置快照：不可变，SIGHUP时由主线程整体替换（RCU方式），读者只需一次acquire读取指针，不加锁
+// 旧快照不释放（每次重新加载一个Config大小），所以读者不需要登记宽限期，拿到的引用始终有效
+extern std::atomic<const Config*> g_live_cfg;
+inline const Config& live_cfg() {
+    return *g_live_cfg.load(std::memory_order_acquire);
+}
+// 在主线程中调用：重新读取配置文件并发布新快照，需要重启才能修改的成员保持当前值
+// 返回新快照，读取失败时返回NULL（继续使用当前快照）
+const Config* reload_config(const char* config_path);
+
+#endif
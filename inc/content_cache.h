@@ -0,0 +1,117 @@
+#ifndef CONTENT_CACHE_HEADER
+#define CONTENT_CACHE_HEADER
+
+// 小文件内容缓存
+// 原理：小文件（如favicon、CSS）每次请求都要mmap/munmap一次并重新格式化响应头，开销主要在页表操作和格式化上。
+//  对于不超过阈值的文件，把状态行之后的响应（头部+文件内容）序列化到一块连续内存中，命中时只需在写缓冲区中写入状态行和Date，
+//  与缓存的内容一起用一次writev发送。
+//  缓存条目以文件的身份和版本（设备、inode、大小、修改时间，与ETag相同）以及影响响应头的请求属性
+//  （Connection方式、是否作为预压缩表示发送、是否需要Vary）为键，不引用FileCache::Entry，也不持有文件的fd；
+//  文件发生变化后键随之改变，旧内容自然无法再被查到，只占用内存，随后被CLOCK算法淘汰。
+//  总内存有上限，按分片各自维护CLOCK环：命中时设置访问位，淘汰时跳过（并清除）访问位为1的条目。
+//  条目使用引用计数，被淘汰时正在发送的连接不受影响。
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "locker.h"
+#include "file_cache.h"
+
+class ContentCache {
+public:
+    struct Key {
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        int64_t mtime_ns;
+        uint32_t flags;     // FLAG_*
+        bool operator==(const Key& o) const {
+            return ino == o.ino && mtime_ns == o.mtime_ns && size == o.size && dev == o.dev && flags == o.flags;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = (uint64_t)k.ino * 0x9E3779B97F4A7C15ULL ^ (uint64_t)k.mtime_ns ^ ((uint64_t)k.flags << 59);
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    struct Entry {
+        char* data;     // 完整响应
+        size_t len;
+        size_t charge;  // 计入内存预算的大小
+        Key key;
+        bool referenced;    // CLOCK访问位，由分片锁保护
+        std::atomic_int refs;
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t bytes;
+    };
+
+    ContentCache();
+    ~ContentCache();
+    ContentCache(const ContentCache&) = delete;
+    ContentCache& operator=(const ContentCache&) = delete;
+
+    void init(bool enabled, int shards, size_t max_file_size, size_t budget);
+    bool cacheable(off_t file_size) const {
+        return m_enabled && file_size > 0 && (size_t)file_size <= m_max_file_size;
+    }
+    // 命中时返回持有一个引用的条目，未命中返回NULL
+    // encoded：file是作为另一个URL的预压缩表示发送的；vary：响应带有Vary头部（两者都使响应头不同）
+    Entry* acquire(const FileCache::Entry* file, bool linger, bool encoded, bool vary);
+    // 以header为响应头、file的内容为响应体生成条目并放入缓存，失败返回NULL；只在调用期间读取file->fd
+    Entry* insert(const FileCache::Entry* file, bool linger, bool encoded, bool vary,
+                  const char* header, size_t header_len);
+    static void release(Entry* entry);
+
+    Stats stats() const;
+
+private:
+    struct Shard {
+        locker lock;
+        std::unordered_map<Key, Entry*, KeyHash> map;
+        std::vector<Entry*> ring;   // CLOCK环
+        size_t hand;
+        size_t used;
+        char pad[64];
+    };
+
+    enum {
+        FLAG_LINGER = 1, FLAG_ENCODED = 2, FLAG_VARY = 4
+    };
+    static Key make_key(const FileCache::Entry* file, bool linger, bool encoded, bool vary) {
+        Key key;
+        key.dev = file->st.st_dev;
+        key.ino = file->st.st_ino;
+        key.size = file->st.st_size;
+        key.mtime_ns = (int64_t)file->st.st_mtim.tv_sec * 1000000000LL + file->st.st_mtim.tv_nsec;
+        key.flags = (linger ? FLAG_LINGER : 0) | (encoded ? FLAG_ENCODED : 0) | (vary ? FLAG_VARY : 0);
+        return key;
+    }
+    Shard& shard_of(const Key& key) {
+        return m_shards[(KeyHash()(key) >> 32) & m_shard_mask];
+    }
+    void evict_locked(Shard& shard, size_t need);
+
+    bool m_enabled;
+    Shard* m_shards;
+    uint32_t m_shard_mask;
+    size_t m_max_file_size;
+    size_t m_shard_budget;
+
+    // 命中/未命中次数记录在每线程的统计中（metrics.h）
+    std::atomic<uint64_t> m_evictions;
+};
+
+extern ContentCache content_cache;
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef FILE_CACHE_HEADER
+#define FILE_CACHE_HEADER
+
+// 打开文件与元数据缓存
+// 原理：do_request对每个请求都要执行realpath、stat、access、open等路径相关的系统调用，而热点文件往往只有少数几个。
+//  因此以规范化后的URL为键，缓存解析后的真实路径、struct stat以及一个已打开的fd，命中时不再产生任何路径相关的系统调用。
+//  缓存按URL哈希分片，每个分片一把锁，降低多个线程同时查找时的竞争。
+//  Entry使用引用计数：缓存本身持有一个引用，每个正在使用该文件的连接各持有一个引用，最后一个引用释放时才关闭fd，
+//  所以条目被淘汰时，正在发送该文件的连接不受影响。
+//  由于fd被多个连接共享，sendfile时必须显式传入偏移量，不能依赖fd自身的文件偏移。
+//  失效机制：inotify监听DOC_ROOT（及其子目录），文件内容/属性改变时按路径失效，目录结构改变（创建、删除、重命名）时全部失效；
+//  另外可以配置TTL作为兜底（例如inotify不可用或监听数达到上限时）。
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <stdint.h>
+
+#include "locker.h"
+
+class FileCache {
+public:
+    enum RESULT {
+        FILE_OK = 0, FILE_NOT_FOUND, FILE_FORBIDDEN, FILE_IS_DIR
+    };
+    // 预压缩的同名文件（foo.js.gz、foo.js.br），Entry::encodings中的位
+    enum ENCODING {
+        ENCODING_GZIP = 1, ENCODING_BR = 2
+    };
+
+    struct Entry {
+        std::string path;       // realpath解析后的路径
+        struct stat st;
+        int fd;                 // 只读打开的文件，所有持有者共享
+        // 条件请求使用的验证器，加载时按st生成一次，之后每个请求直接复制
+        char etag[64];          // 强ETag："inode-size-mtime(ns)"（十六进制，含引号）
+        char last_modified[32]; // IMF-fixdate格式的修改时间
+        // 加载时旁边存在的预压缩文件（ENCODING位），请求时不再为此stat；
+        // 创建或删除同名文件属于目录结构变化，inotify会使所有条目失效并重新检查
+        int encodings;
+        uint64_t generation;    // 加载时的全局代数，与当前代数不一致说明已失效
+        int64_t expire_ms;      // 过期时间（单调时钟），0表示不按时间过期
+        std::atomic_int refs;
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    FileCache();
+    ~FileCache();
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // enabled == false时每次都走加载流程，但接口不变
+    void init(const char* doc_root, bool enabled, int shards, int max_entries, int ttl_sec);
+    // 查找（或加载）url对应的文件，成功时*out持有一个引用，使用完毕后必须调用release()
+    RESULT acquire(const char* url, Entry** out);
+    // 只查找缓存，不做任何文件系统操作，未命中返回false（用于不允许阻塞的调用者）
+    bool lookup(const char* url, Entry** out);
+    static void release(Entry* entry);
+
+    void invalidate_all();
+    // 失效路径为path的条目，prefix为true时同时失效path目录下的所有条目
+    void invalidate_path(const char* path, bool prefix);
+
+    Stats stats() const;
+
+private:
+    struct Shard {
+        locker lock;
+        std::unordered_map<std::string, Entry*> map;
+        char pad[64];   // 避免相邻分片的锁位于同一缓存行
+    };
+
+    Shard& shard_of(const std::string& key) {
+        return m_shards[std::hash<std::string>()(key) & m_shard_mask];
+    }
+    RESULT load(const char* url, Entry** out);
+    static void make_validators(Entry* entry);
+    static int probe_encodings(const char* path);
+    bool expired(const Entry* entry, int64_t now) const;
+    void evict_locked(Shard& shard, std::unordered_map<std::string, Entry*>::iterator it);
+
+    bool start_inotify();
+    void watch_tree(const char* dir);
+    static void* inotify_worker(void* arg);
+    void handle_events();
+
+    std::string m_doc_root;
+    bool m_enabled;
+    Shard* m_shards;
+    uint32_t m_shard_mask;
+    size_t m_shard_capacity;    // 每个分片最多缓存的条目数
+    int m_ttl_ms;
+
+    std::atomic<uint64_t> m_generation;
+    // 命中/未命中次数记录在每线程的统计中（metrics.h），不在这里争用同一个计数器
+    std::atomic<uint64_t> m_evictions;
+
+    int m_inotify_fd;
+    std::unordered_map<int, std::string> m_watch_dirs;  // wd -> 目录路径，只由inotify线程访问
+};
+
+extern FileCache file_cache;
+
+#endif
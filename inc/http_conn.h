@@ -19,14 +19,28 @@
 #include <sys/mman.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <atomic>
+#include <vector>
 
 #include "locker.h"
+#include "file_cache.h"
+#include "content_cache.h"
+#include "buffer_pool.h"
+#include "timer_wheel.h"
+#include "metrics.h"
+#include "access_log.h"
+
+class UringReactor;
 
 class HTTPConn {
 public:
     static const int FILENAME_LEN = 260;
-    static const int READ_BUFFER_SIZE = 2048;
-    static const int WRITE_BUFFER_SIZE = 1024;
+    // 一批管线化请求最多生成的响应数（实际上限还受config中pipeline_depth限制）
+    static const int MAX_PIPELINE_DEPTH = 32;
+    // 一次扫描最多索引的头部行数，超过时退回逐行解析
+    static const int MAX_HEADER_LINES = 64;
+    // 一个Range头部最多接受的区间数，超过时忽略Range、返回整个文件（防止用大量小区间放大处理开销）
+    static const int MAX_RANGES = 8;
 
     // HTTP方法
     enum METHOD {
@@ -46,86 +60,281 @@ public:
     enum HTTP_CODE {
         NO_REQUEST, GET_REQUEST, BAD_REQUEST, 
         NO_RESOURCE, FILE_REQUEST, FORBIDDEN_REQUEST, 
-        INTERNAL_ERROR, SERVICE_UNAVAILABLE, CLOSED_CONNECTION
+        INTERNAL_ERROR, SERVICE_UNAVAILABLE, RANGE_NOT_SATISFIABLE, NOT_MODIFIED, CLOSED_CONNECTION,
+        STATS_REQUEST,      // 保留URL（/__stats），返回运行统计
+        DEFERRED_REQUEST    // 请求已解析，但需要交给线程池完成
     };
     enum HTTP_VERSION {
         HTTP1_0 = 0, HTTP1_1, HTTP2_0, HTTP_UNSUPPORTED
     };
+    // 当前生效的超时类型
+    enum TIMEOUT_KIND {
+        TIMEOUT_NONE = 0, TIMEOUT_HEADER, TIMEOUT_IDLE, TIMEOUT_WRITE, TIMEOUT_KINDS
+    };
+    // reactor的就绪列表：发送额度（write_budget）用完、还有数据要发送的连接，reactor在下一次epoll_wait之前继续发送
+    typedef std::vector<HTTPConn*> ReadyList;
+
     HTTPConn() {}
     ~HTTPConn() {}
 
-    void init(int sockfd, int epollfd, const sockaddr_in& addr);
+    // 连接对象表只保留地址空间，对象在accept时用placement new构造
+    static HTTPConn* create_table(int n);
+    static void destroy_table(HTTPConn* table, int n);
+
+    // uring不为NULL时连接由io_uring reactor驱动，不注册到epollfd
+    // 必须在所属reactor的线程中调用：epoll方式下由它自己把sockfd注册到epollfd
+    // reactor_users为所属reactor的连接数（主反应堆按它选择负载最轻的reactor），建立时加一、关闭时减一
+    // ready为所属reactor的就绪列表，NULL时不限制每次发送的字节数
+    void init(int sockfd, int epollfd, const sockaddr_in& addr, BufferPool* pool, TimerWheel* timers,
+              UringReactor* uring = NULL, std::atomic_int* reactor_users = NULL, ReadyList* ready = NULL);
     void close_conn(bool real_close = true);
     void close_conn_write();
     void process();
+    bool process_inline();
     bool read();
     bool write();
+    // 响应已全部发送，但读缓冲区中还有未处理的数据（管线化的后续请求），调用者需要继续处理
+    bool has_pending_input() const { return m_resp_count == 0 && m_end_pos > 0; }
+    // 还有没发送完的响应
+    bool sending() const { return m_resp_count > 0; }
+    // reactor收到该连接的事件：EPOLLONESHOT注册在事件产生后失效
+    void on_event() {
+        if (m_ep_state == EP_ONESHOT_ARMED) {
+            m_ep_state = EP_ONESHOT_FIRED;
+        }
+    }
+
+    // reactor从就绪列表中取出连接时调用：返回false表示排队期间连接已经关闭（对象可能已属于新连接）、
+    // 已经在其他地方继续发送过，或者已交给线程池，跳过即可
+    bool take_ready() {
+        if (!m_ready_queued || m_in_worker.load(std::memory_order_relaxed) > 0) {
+            return false;
+        }
+        m_ready_queued = false;
+        return true;
+    }
 
     void write_respond(HTTP_CODE code, bool send_and_exit);
 
+    // io_uring reactor使用：接收到的数据（对应read()），以及由reactor提交的发送（对应write()）
+    bool append_input(const char* data, size_t len);
+    int send_iov(struct iovec* iv, int max, bool* close_after);
+    bool send_done(ssize_t n);
+
+    // 交给线程池前由reactor调用，工作线程最后一次rearm时计数减一（队列已满时由reactor直接调用leave_worker）；计数不为0时超时被推迟，保证连接只在reactor线程中因超时关闭
+    void enter_worker() {
+        if (m_ep_state == EP_PERSISTENT) {
+            // 常驻注册下reactor会继续收到事件，处理期间先注销，工作线程结束时以EPOLLONESHOT重新注册
+            update_events(EP_NONE, 0);
+        }
+        // 之后由工作线程发送，就绪列表中的条目作废
+        m_ready_queued = false;
+        m_queued_ns = Metrics::now_ns();
+        m_in_worker.fetch_add(1, std::memory_order_relaxed);
+    }
+    void leave_worker() { m_in_worker.fetch_sub(1, std::memory_order_release); }
+    // TimerWheel::expire的检查函数，以及确实到期时reactor执行的关闭操作
+    static bool timer_check(TimerWheel::Node* node, int64_t now, int64_t* next);
+    void expire_timeout();
+
 private:
+    // 微基准（bench/http_bench.cpp）直接驱动解析和响应生成
+    friend class HTTPConnBench;
+
+    // 一个待发送的响应：响应头位于写缓冲区中，响应体在内存中（mmap或内容缓存）或者通过sendfile发送
+    // 响应持有其使用的文件资源，发送完毕后释放
+    struct Response {
+        int header_off;
+        int header_len;
+        const char* body;
+        size_t body_len;
+        int filefd;
+        off_t file_off;
+        size_t file_len;
+        size_t sent;        // 已发送字节数（头部+内存响应体+文件）
+        char* mmap_addr;
+        size_t mmap_len;
+        FileCache::Entry* file_entry;
+        ContentCache::Entry* content_entry;
+        bool linger;
+    };
+    // Range请求中的一个区间[first, last]；mmap方式下map为只覆盖该区间的按页对齐的映射，data指向区间起始字节
+    struct ByteRange {
+        off_t first;
+        off_t last;
+        char* map;
+        size_t map_len;
+        const char* data;
+    };
+
     // 初始化连接
     void init();
+    // epoll中该连接的注册状态：
+    //  EP_NONE：未注册；EP_ONESHOT_ARMED/FIRED：EPOLLONESHOT注册，尚未/已经产生事件（产生后需要MOD才能再次收到事件）；
+    //  EP_PERSISTENT：不带EPOLLONESHOT的边沿触发注册，同时关注读写，之后不再需要epoll_ctl
+    enum EP_STATE {
+        EP_NONE = 0, EP_ONESHOT_ARMED, EP_ONESHOT_FIRED, EP_PERSISTENT
+    };
+    void rearm(int ev);
+    void rearm_from_worker(int ev);
+    // 把注册修改为state/ev（EP_NONE表示注销），调用一次epoll_ctl
+    void update_events(EP_STATE state, int ev);
+    void set_timeout(TIMEOUT_KIND kind);
+    void abort_conn();
+    // 清除单个请求的解析状态，准备解析下一个管线化请求
+    void reset_request();
+    // 解析缓冲区中所有完整的请求并依次生成响应
+    HTTP_CODE process_requests();
     // 解析HTTP
     HTTP_CODE process_read();
     // 填充HTTP应答
     bool process_write(HTTP_CODE ret);
 
-    HTTP_CODE parse_requestline(char* text);
+    HTTP_CODE parse_requestline(char* text, char* end);
     HTTP_CODE parse_headers(char* text);
+    HTTP_CODE parse_header(const char* name, int name_len, char* value);
+    bool parse_header_block(HTTP_CODE* ret);
     HTTP_CODE parse_content(char* text);
     HTTP_CODE do_request();
+    bool select_encoding(const char* url, FileCache::Entry** entry, int usable);
+    bool not_modified(const FileCache::Entry* entry) const;
+    int parse_ranges(off_t size);
+    bool if_range_matches(const FileCache::Entry* entry) const;
+    bool map_ranges(int fd);
+    void release_ranges();
     char* get_line() {return m_read_buf + m_start_line;}
     LINE_STATUS parse_line();
 
     void unmap();
-    bool add_response(const char* format, ...);
-    bool add_content(const char* content);
+    bool ensure_read_buf();
+    bool grow_read_buf();
+    void compact_read_buf();
+    void rebase_read_ptrs(const char* old_base, char* new_base);
+    bool ensure_write_buf();
+    bool grow_write_buf();
+    void release_buffers();
+    bool ensure_responses();
+    // *file_follows表示填充的数据之后紧接着要用sendfile发送文件内容
+    int build_iov(struct iovec* iv, int max, bool* file_follows = NULL);
+    void advance(size_t n);
+    // 发送结果：WRITE_CLOSING表示需要关闭写端（出错或Connection: close），WRITE_BLOCKED表示等待EPOLLOUT（或在就绪列表中），
+    // WRITE_DONE表示全部发送并等待下一个请求，WRITE_MORE_INPUT表示读缓冲区中还有后续请求（没有重新注册事件）
+    enum WRITE_RESULT {
+        WRITE_CLOSING = 0, WRITE_BLOCKED, WRITE_DONE, WRITE_MORE_INPUT
+    };
+    WRITE_RESULT send_responses();
+    WRITE_RESULT finish_write();
+    void rearm_closing();
+    void yield_write();
+    void finish_response(Response& r);
+    void release_responses();
+    Response& push_response(int header_off);
+    bool add_range_responses(int header_off);
+    // 响应头构造：常量片段直接memcpy，整数用format_uint
+    bool append(const char* data, size_t len);
+    bool append(const char* str) { return append(str, strlen(str)); }
+    template <size_t N>
+    bool append_literal(const char (&str)[N]) { return append(str, N - 1); }
+    bool append_uint(uint64_t v);
     bool add_status_line(int status, const char* title);
-    bool add_headers(int content_length);
-    bool add_content_length(int content_length);
+    bool add_headers(long long content_length);
+    bool add_content_length(long long content_length);
     bool add_linger();
+    bool add_accept_ranges();
+    bool add_validators();
+    bool add_encoding();
     bool add_blank_line();
+    // 为刚生成的响应（从m_resp[first_resp]开始）记录一条访问日志
+    void log_access(int first_resp, uint64_t handle_ns);
 
 public:
     // static int m_epollfd;
     int m_epollfd;  // 每个user对应的epollfd可能不同了
-    static int m_user_count;
+    static std::atomic_int m_user_count;   // 多个reactor会同时建立/关闭连接
+    static std::atomic<uint64_t> m_timeouts[TIMEOUT_KINDS];    // 按类型统计的超时次数
 
 private:
     int m_sockfd{-1};
     sockaddr_in m_address;
 
-    char m_read_buf[READ_BUFFER_SIZE];
+    // 读写缓冲区只在请求处理期间从m_pool借用，空闲时为NULL
+    BufferPool* m_pool{NULL};
+    char* m_read_buf{NULL};
+    int m_read_size{0};
     int m_end_pos;
     int m_cur_pos;
     int m_start_line;
+    int m_req_start;    // 当前（尚未处理完的）请求在缓冲区中的起始位置
 
-    char m_write_buf[WRITE_BUFFER_SIZE];
+    char* m_write_buf{NULL};
+    int m_write_size{0};
     int m_write_idx;
-    int m_bytes_to_send;
     CHECK_STATE m_check_state;
     METHOD m_method;
 
-    char m_real_file[FILENAME_LEN];
     char* m_url;
     char* m_version;
     HTTP_VERSION m_http_ver;
     char* m_host;
     int m_content_length;
     bool m_linger;
+    char* m_range;      // Range头部的值，没有时为NULL
+    char* m_if_range;
+    char* m_if_none_match;
+    char* m_if_modified_since;
+    int m_accept_encoding;  // 客户端接受的预压缩格式（FileCache::ENCODING位）
+    // 预压缩：发送的文件的Content-Encoding（NULL表示原文件），资源有压缩版本时需要Vary
+    const char* m_content_encoding;
+    bool m_vary;
 
     // mmap+writev
     char* m_file_address;
-    struct stat m_file_stat;
+    off_t m_file_size;
     // sendfile
     int m_filefd;
+    // 当前请求持有的文件缓存条目
+    FileCache::Entry* m_file_entry;
+    // 小文件缓存命中时的完整响应
+    ContentCache::Entry* m_content_entry;
+    // Range请求：满足条件的区间，每个区间生成一个响应体（sendfile使用显式偏移，mmap使用各自的窗口）
+    // 最多MAX_RANGES项，只在解析Range到生成响应期间从m_pool借用，其余时间为NULL
+    ByteRange* m_ranges{NULL};
+    int m_range_count;
+
+    // 管线化：按请求顺序排列的响应队列，从内存池借用，空闲时为NULL
+    Response* m_resp{NULL};
+    int m_resp_cap{0};
+    int m_resp_limit{0};    // pipeline_depth：一批最多处理的请求数，m_resp_cap另外为多区间响应预留了空间
+    int m_resp_head;    // 第一个未发送完的响应
+    int m_resp_count;
+    bool m_last_linger; // 最后一个发送完的响应的Connection方式
+    int m_status;       // 最近生成的响应的状态码（访问日志）
+
+    // 超时：m_timer位于所属reactor的时间轮中，到期时间与类型可能由工作线程修改
+    TimerWheel* m_timers{NULL};
+    TimerWheel::Node m_timer;
+    std::atomic<int64_t> m_deadline_ms{0};
+    std::atomic_int m_timeout_kind{TIMEOUT_NONE};
+    std::atomic_int m_in_worker{0};
+
+    // io_uring reactor，epoll方式下为NULL
+    UringReactor* m_uring{NULL};
+    // 当前的epoll注册状态与关注的事件，同一时间只由处理该连接的线程访问
+    EP_STATE m_ep_state{EP_NONE};
+    int m_ep_events{0};
+    std::atomic_int* m_reactor_users{NULL};
+    // 发送额度用完时加入的就绪列表，以及是否已在列表中（只由reactor线程访问）
+    ReadyList* m_ready{NULL};
+    bool m_ready_queued{false};
 
-    struct iovec m_iv[2];
-    int m_iv_count;
+    // run-to-completion
+    bool m_run_inline;  // 当前在reactor线程中处理，不允许阻塞
+    bool m_deferred;    // 已解析完毕、等待线程池执行do_request
 
-    // 已传输数据
-    uint m_bytes_sent;
+    // 延迟统计的时间戳（纳秒），连接同一时间只由一个线程处理，不需要同步
+    uint64_t m_queued_ns;   // 交给线程池的时间
+    uint64_t m_batch_ns;    // 当前这批请求最早读到数据的时间，0表示没有
+    uint64_t m_write_ns;    // 当前这批响应生成完毕的时间
 };
 
 #endif
\ No newline at end of file
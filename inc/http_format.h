@@ -0,0 +1,22 @@
+#ifndef HTTP_FORMAT_HEADER
+#define HTTP_FORMAT_HEADER
+
+// 响应头格式化的基本操作
+// 原理：原先每个响应头字段都通过vsnprintf格式化，需要解析格式串、处理可变参数，整数还要逐位做除法。
+//  响应头几乎全部由常量片段组成，直接memcpy即可；整数用两位一组的查表法转换，除法次数减半；
+//  Date头部的内容每秒才变化一次，每个线程缓存格式化好的结果，秒数变化时才重新格式化。
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 一个无符号整数的十进制形式最多的字节数
+static const size_t UINT_DIGITS_MAX = 20;
+
+// 把v写成十进制到buf（至少UINT_DIGITS_MAX字节，不写'\0'），返回长度
+size_t format_uint(char* buf, uint64_t v);
+// 把v写成16位十六进制到buf（不写'\0'）
+void format_hex64(char* buf, uint64_t v);
+// 当前时间的"Date: ...\r\n"，*len为其长度；返回的缓冲区属于调用线程，在下一次调用前有效
+const char* date_header(size_t* len);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HTTP_SCAN_HEADER
+#define HTTP_SCAN_HEADER
+
+// HTTP请求的向量化扫描
+// 原理：parse_line逐字节寻找\r/\n，parse_requestline/parse_headers又用strpbrk/strspn/strcasecmp把同样的字节再扫一遍。
+//  这里用SIMD一次比较16（SSE4.2）或32（AVX2）个字节：把数据与'\r'、'\n'、':'等分隔符比较，得到位掩码，
+//  再用ctz逐个取出分隔符的位置，没有分隔符的块只需要一次比较就能跳过。
+//  头部完整到达时（常见情况），scan_headers一次扫描就得到所有头部行的名字和值的偏移。
+//  具体实现在程序启动时根据cpuid选择，不支持SSE4.2的CPU（或非x86平台）使用标量实现。
+
+#include <stddef.h>
+
+// 一个头部行在缓冲区中的位置；没有冒号的行name_len为整行长度，value_off为-1
+struct HeaderSpan {
+    int name_off;
+    int name_len;
+    int value_off;      // 已跳过冒号后的空白
+    int value_len;      // 值一直到行尾的\r
+};
+
+enum ScanImpl {
+    SCAN_SCALAR = 0, SCAN_SSE42, SCAN_AVX2
+};
+
+// scan_headers的返回值（非负时为头部行数）
+static const int SCAN_INCOMPLETE = -1;  // 头部尚未完整到达，或行数超过max
+static const int SCAN_BAD = -2;         // 出现不成对的\r或\n
+
+// 返回[p, end)中第一个'\r'或'\n'的位置，没有则返回end
+const char* scan_eol(const char* p, const char* end);
+// 返回[p, end)中第一个' '或'\t'的位置，没有则返回end
+const char* scan_space(const char* p, const char* end);
+// 扫描buf开头的头部块（直到空行），把每个头部行的位置写入spans，*consumed为包括空行在内的字节数
+int scan_headers(const char* buf, size_t len, HeaderSpan* spans, int max, size_t* consumed);
+
+// 强制使用指定实现（用于测试和基准测试），CPU不支持时返回false
+bool scan_select(ScanImpl impl);
+const char* scan_impl_name();
+
+#endif
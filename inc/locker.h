@@ -6,6 +6,10 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 // 信号量
 class sem {
@@ -33,6 +37,42 @@ private:
     sem_t m_sem;
 };
 
+// 基于eventfd的事件
+// 与信号量不同，多次post在被wait之前只会合并为一次唤醒，适合"挂起/唤醒"某个线程的场景；
+// fd也可以直接加入epoll监听
+class event {
+public:
+    // semaphore为true时使用EFD_SEMAPHORE语义：每次wait只消耗一次post，可用于唤醒多个等待者
+    explicit event(bool semaphore = false) {
+        m_fd = eventfd(0, EFD_CLOEXEC | (semaphore ? EFD_SEMAPHORE : 0));
+        if (m_fd < 0) {
+            throw std::exception();
+        }
+    }
+    ~event() {
+        close(m_fd);
+    }
+    // 阻塞直到被post
+    bool wait() {
+        uint64_t val;
+        while (::read(m_fd, &val, sizeof(val)) != sizeof(val)) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // 唤醒等待者
+    bool post(uint64_t val = 1) {
+        return ::write(m_fd, &val, sizeof(val)) == sizeof(val);
+    }
+    int fd() const {
+        return m_fd;
+    }
+private:
+    int m_fd;
+};
+
 class cond {
 public:
     // 条件变量初始化
@@ -1,9 +1,13 @@
 #ifndef LOCKFREE_HEADER
 #define LOCKFREE_HEADER
 
+#include <algorithm>
 #include <vector>
 #include <atomic>
 #include <stdexcept>
+#include <stdint.h>
+
+#include "locker.h"
 
 // 适用于单生产者单消费者的无锁队列
 // 原理：首先队列采用RingBuffer（环形数组），这使得我们只需要修改writer_ptr和reader_ptr即可实现生产者的写入和消费者的取出。
@@ -39,7 +43,8 @@ public:
         return writer_ptr.load(std::memory_order_acquire) == reader_ptr.load(std::memory_order_acquire);
     }
     bool full() const {
-        return (writer_ptr.load(std::memory_order_acquire) + 1) % q.size() == reader_ptr.load(std::memory_order_acquire);
+        int next_writer = (writer_ptr.load(std::memory_order_acquire) + 1) % q.size();
+        return next_writer == reader_ptr.load(std::memory_order_acquire);
     }
     bool push(const T& item) {
         int writer = writer_ptr.load(std::memory_order_relaxed);
@@ -69,4 +74,322 @@ public:
     }
 };
 
-#endif
\ No newline at end of file
+// Chase-Lev工作窃取双端队列（固定容量）
+// 原理：队列只有一个所有者，所有者在bottom端push/pop（LIFO），其他线程（窃取者）在top端steal（FIFO）。
+//  所有者操作bottom时不需要原子RMW，只有当队列中只剩最后一个元素、所有者和窃取者可能争抢同一个元素时，
+//  双方通过对top的CAS决出胜负。
+//  实现参考Lê等人《Correct and Efficient Work-Stealing for Weak Memory Models》中的C11版本。
+//  容量为2的幂，下标用掩码计算；队列满时push返回false，由调用者决定如何处理。
+template <typename T>
+class WorkStealingDeque {
+    std::atomic<int64_t> m_top;
+    char pad0[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> m_bottom;
+    char pad1[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<T>* m_buf;
+    int64_t m_mask;
+public:
+    WorkStealingDeque() : m_top(0), m_bottom(0), m_buf(nullptr), m_mask(0) {
+        // 同LockFreeQueue_SPSC，之后调用init_queue()完成初始化
+    }
+    ~WorkStealingDeque() {
+        delete[] m_buf;
+    }
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    void init_queue(int len) {
+        int64_t cap = 2;
+        while (cap < len) {
+            cap <<= 1;
+        }
+        delete[] m_buf;
+        m_buf = new std::atomic<T>[cap];
+        m_mask = cap - 1;
+        m_top.store(0);
+        m_bottom.store(0);
+    }
+
+    // 仅所有者调用
+    bool push(const T& item) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed);
+        int64_t t = m_top.load(std::memory_order_acquire);
+        if (b - t > m_mask) {
+            return false;   // 满
+        }
+        m_buf[b & m_mask].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+    // 仅所有者调用
+    bool pop(T& item_out) {
+        int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = m_top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // 空
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item_out = m_buf[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // 最后一个元素，与窃取者竞争
+            bool won = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+    // 任意线程调用
+    bool steal(T& item_out) {
+        int64_t t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return false;
+        }
+        item_out = m_buf[t & m_mask].load(std::memory_order_relaxed);
+        return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+    bool empty() const {
+        return m_bottom.load(std::memory_order_acquire) <= m_top.load(std::memory_order_acquire);
+    }
+    std::size_t capacity() const {
+        return m_mask + 1;
+    }
+};
+
+// 有界多生产者多消费者无锁队列（Vyukov MPMC）
+// 原理：RingBuffer中每个槽位带有一个序号seq，生产者和消费者分别通过CAS推进enqueue_pos/dequeue_pos来占有槽位。
+//  对于位置pos，槽位seq == pos表示可写，seq == pos + 1表示可读；写入完成后把seq置为pos + 1，
+//  读取完成后把seq置为pos + 容量，即下一圈的可写位置。占有槽位后对数据的读写不需要再竞争。
+//  与LockFreeQueue_SPSC相比：容量为2的幂，用掩码代替取模；enqueue_pos和dequeue_pos位于不同的缓存行，
+//  生产者和消费者之间不会因伪共享互相干扰；任意数量的生产者/消费者都是安全的。
+//  push_bulk/pop_bulk一次CAS占有连续的多个槽位，批量提交时减少原子操作的次数。
+template <typename T>
+class LockFreeQueue_MPMC {
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        T data;
+    };
+    char pad0[64];
+    std::atomic<std::size_t> m_enqueue_pos;
+    char pad1[64 - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> m_dequeue_pos;
+    char pad2[64 - sizeof(std::atomic<std::size_t>)];
+    Cell* m_buf;
+    std::size_t m_mask;
+public:
+    LockFreeQueue_MPMC() : m_enqueue_pos(0), m_dequeue_pos(0), m_buf(nullptr), m_mask(0) {
+        // 同LockFreeQueue_SPSC，之后调用init_queue()完成初始化
+    }
+    explicit LockFreeQueue_MPMC(int queue_len) : LockFreeQueue_MPMC() {
+        if (queue_len < 2) throw std::invalid_argument("queue len must be greater than 1");
+        init_queue(queue_len);
+    }
+    ~LockFreeQueue_MPMC() {
+        delete[] m_buf;
+    }
+    LockFreeQueue_MPMC(const LockFreeQueue_MPMC&) = delete;
+    LockFreeQueue_MPMC& operator=(const LockFreeQueue_MPMC&) = delete;
+
+    // 容量向上取整为2的幂
+    void init_queue(int len) {
+        std::size_t cap = 2;
+        while (cap < (std::size_t)len) {
+            cap <<= 1;
+        }
+        delete[] m_buf;
+        m_buf = new Cell[cap];
+        for (std::size_t i = 0; i < cap; i++) {
+            m_buf[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = cap - 1;
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(const T& item) {
+        Cell* cell;
+        std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_buf[pos & m_mask];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;   // 满
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& item_out) {
+        Cell* cell;
+        std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &m_buf[pos & m_mask];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;   // 空
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        item_out = cell->data;
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+    // 尽可能多地写入（最多n个），返回实际写入的个数
+    std::size_t push_bulk(const T* items, std::size_t n) {
+        std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        std::size_t k;
+        while (true) {
+            // 统计从pos开始连续可写的槽位
+            for (k = 0; k < n; k++) {
+                if (m_buf[(pos + k) & m_mask].seq.load(std::memory_order_acquire) != pos + k) {
+                    break;
+                }
+            }
+            if (k == 0) {
+                intptr_t dif = (intptr_t)m_buf[pos & m_mask].seq.load(std::memory_order_acquire) - (intptr_t)pos;
+                if (dif < 0 || n == 0) {
+                    return 0;   // 满
+                }
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (std::size_t i = 0; i < k; i++) {
+            Cell& cell = m_buf[(pos + i) & m_mask];
+            cell.data = items[i];
+            cell.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return k;
+    }
+    // 尽可能多地取出（最多n个），返回实际取出的个数
+    std::size_t pop_bulk(T* items_out, std::size_t n) {
+        std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        std::size_t k;
+        while (true) {
+            for (k = 0; k < n; k++) {
+                if (m_buf[(pos + k) & m_mask].seq.load(std::memory_order_acquire) != pos + k + 1) {
+                    break;
+                }
+            }
+            if (k == 0) {
+                intptr_t dif = (intptr_t)m_buf[pos & m_mask].seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+                if (dif < 0 || n == 0) {
+                    return 0;   // 空
+                }
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (std::size_t i = 0; i < k; i++) {
+            Cell& cell = m_buf[(pos + i) & m_mask];
+            items_out[i] = cell.data;
+            cell.seq.store(pos + i + m_mask + 1, std::memory_order_release);
+        }
+        return k;
+    }
+    // 近似值，并发修改时仅供参考
+    std::size_t size() const {
+        std::size_t enq = m_enqueue_pos.load(std::memory_order_relaxed);
+        std::size_t deq = m_dequeue_pos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+    std::size_t capacity() const {
+        return m_mask + 1;
+    }
+};
+
+// LockFreeQueue_MPMC的阻塞包装
+// 队列为空时消费者通过eventfd（信号量语义）挂起；生产者只在有消费者挂起时才写eventfd，
+// 队列非空时push/pop都不会进入内核
+template <typename T>
+class BlockingQueue_MPMC {
+    LockFreeQueue_MPMC<T> m_q;
+    event m_ready;
+    std::atomic<int> m_waiters;
+public:
+    BlockingQueue_MPMC() : m_ready(true), m_waiters(0) {}
+    explicit BlockingQueue_MPMC(int queue_len) : m_q(queue_len), m_ready(true), m_waiters(0) {}
+    void init_queue(int len) {
+        m_q.init_queue(len);
+    }
+
+    bool push(const T& item) {
+        if (!m_q.push(item)) {
+            return false;
+        }
+        // 写入（release）与读取m_waiters之间需要完整的屏障：否则读取可能提前到写入之前（StoreLoad重排），
+        // 与pop_bulk_wait中的登记、再检查交错时双方都看不到对方，消费者阻塞而生产者不唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) > 0) {
+            m_ready.post();
+        }
+        return true;
+    }
+    std::size_t push_bulk(const T* items, std::size_t n) {
+        std::size_t k = m_q.push_bulk(items, n);
+        if (k > 0) {
+            // 同push
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int waiters = m_waiters.load(std::memory_order_relaxed);
+            if (waiters > 0) {
+                m_ready.post(std::min<std::size_t>(k, waiters));
+            }
+        }
+        return k;
+    }
+    bool try_pop(T& item_out) {
+        return m_q.pop(item_out);
+    }
+    // 至少取出一个元素（最多n个），队列为空时阻塞
+    std::size_t pop_bulk_wait(T* items_out, std::size_t n) {
+        while (true) {
+            std::size_t k = m_q.pop_bulk(items_out, n);
+            if (k > 0) {
+                return k;
+            }
+            // 先登记为等待者再检查一次，与push中"先写入再检查等待者"配对，避免丢失唤醒
+            m_waiters.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            k = m_q.pop_bulk(items_out, n);
+            if (k > 0) {
+                m_waiters.fetch_sub(1, std::memory_order_relaxed);
+                return k;
+            }
+            m_ready.wait();
+            m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    std::size_t size() const {
+        return m_q.size();
+    }
+    std::size_t capacity() const {
+        return m_q.capacity();
+    }
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef METRICS_HEADER
+#define METRICS_HEADER
+
+// 运行统计：计数器与各阶段的延迟直方图
+// 原理：所有线程共用的原子计数器在每次更新时都要独占所在的缓存行，线程越多争用越严重。
+//  这里每个线程拥有自己的统计槽（按缓存行对齐，互不共享），只有该线程写入，更新只是一次普通的读-加-写
+//  （relaxed原子操作，不带lock前缀），不加锁；读取时（/__stats）遍历所有线程的槽合并，只有这时才有跨线程访问。
+//  线程第一次记录时注册自己的槽（只有这一次加锁），槽在进程生命周期内不释放。
+//  延迟直方图为对数-线性分桶（HdrHistogram方式）：每个2的幂区间再等分为SUB_COUNT个桶，相对误差不超过1/SUB_COUNT，
+//  记录时只需一次前导零计数和移位。
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+#include "locker.h"
+
+// 对数-线性直方图的分桶方式，值的单位为纳秒
+struct HistogramLayout {
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    // 最大约68.7秒，更大的值计入最后一个桶
+    static const int MAX_BITS = 36;
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    static int bucket_of(uint64_t v) {
+        if (v < (uint64_t)SUB_COUNT) {
+            return (int)v;
+        }
+        if (v >= (1ULL << MAX_BITS)) {
+            return BUCKETS - 1;
+        }
+        int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        return (shift + 1) * SUB_COUNT + (int)((v >> shift) - SUB_COUNT);
+    }
+    // 桶中的最大值
+    static uint64_t bucket_upper(int idx) {
+        if (idx < SUB_COUNT) {
+            return idx;
+        }
+        int shift = idx / SUB_COUNT - 1;
+        uint64_t lower = (uint64_t)(SUB_COUNT + idx % SUB_COUNT) << shift;
+        return lower + (1ULL << shift) - 1;
+    }
+};
+
+// 合并后的直方图
+struct HistogramSnapshot {
+    uint64_t counts[HistogramLayout::BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    // 单线程使用时直接记录（bench/loadgen）
+    void add(uint64_t v, uint64_t n = 1) {
+        counts[HistogramLayout::bucket_of(v)] += n;
+        count += n;
+        sum += v * n;
+        if (v > max) {
+            max = v;
+        }
+    }
+    void merge(const HistogramSnapshot& other);
+    // q分位数（所在桶的上界，不超过max），没有数据时为0
+    uint64_t quantile(double q) const;
+};
+
+class Metrics {
+public:
+    enum COUNTER {
+        ACCEPTS = 0,
+        // 按状态码统计的响应数
+        STATUS_200, STATUS_206, STATUS_304,
+        STATUS_400, STATUS_403, STATUS_404, STATUS_416,
+        STATUS_500, STATUS_503, STATUS_OTHER,
+        BYTES_SENT,
+        QUEUE_FULL,         // 线程池队列已满而返回的503
+        EPOLL_CTL,
+        EPOLL_CTL_SKIPPED,  // 注册已满足要求而省去的epoll_ctl
+        WRITE_YIELDS,       // 发送额度（write_budget）用完而让出reactor的次数
+        ACCESS_LOG_DROPS,   // 访问日志队列已满而丢弃的记录
+        FILE_CACHE_HITS, FILE_CACHE_MISSES,
+        CONTENT_CACHE_HITS, CONTENT_CACHE_MISSES,
+        COUNTERS
+    };
+    enum PHASE {
+        PHASE_QUEUE = 0,    // 交给线程池到开始处理
+        PHASE_HANDLE,       // 单个请求的解析、查找文件和生成响应头
+        PHASE_WRITE,        // 一批响应从生成完毕到全部发送
+        PHASE_TOTAL,        // 一批请求从读到数据到全部发送
+        PHASES
+    };
+
+    struct Snapshot {
+        uint64_t counters[COUNTERS];
+        HistogramSnapshot phases[PHASES];
+    };
+
+    Metrics() {}
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    void add(COUNTER c, uint64_t n = 1) {
+        bump(local().counters[c], n);
+    }
+    void count_status(int status) {
+        add(status_counter(status));
+    }
+    void record(PHASE phase, uint64_t ns) {
+        Histogram& h = local().phases[phase];
+        bump(h.counts[HistogramLayout::bucket_of(ns)], 1);
+        bump(h.sum, ns);
+        if (ns > h.max.load(std::memory_order_relaxed)) {
+            h.max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    // 合并所有线程的数据；与记录并发进行，各个值分别是某一时刻的值，彼此之间不保证一致
+    void snapshot(Snapshot* out);
+    uint64_t total(COUNTER c);
+    // 输出到buf（不写'\0'），返回长度；空间不够时截断
+    size_t render_json(char* buf, size_t size);
+    size_t render_prometheus(char* buf, size_t size);
+
+private:
+    struct Histogram {
+        std::atomic<uint64_t> counts[HistogramLayout::BUCKETS];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+    };
+    // 一个线程的统计槽，按缓存行对齐并分配，与其他线程的槽不共享缓存行
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> counters[COUNTERS];
+        Histogram phases[PHASES];
+    };
+
+    // 只有所属线程写入，不需要原子的读-改-写
+    static void bump(std::atomic<uint64_t>& v, uint64_t n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static COUNTER status_counter(int status);
+    Slot& local() {
+        if (__builtin_expect(t_slot == NULL, 0)) {
+            t_slot = register_thread();
+        }
+        return *t_slot;
+    }
+    Slot* register_thread();
+
+    static __thread Slot* t_slot;
+    locker m_lock;
+    std::vector<Slot*> m_slots;
+};
+
+extern Metrics metrics;
+
+#endif
@@ -5,9 +5,20 @@
 // 线程池：
 //  线程池使用生产者-消费者模型，主线程（生产者）通过互斥锁保护的任务队列提交任务，工作线程（消费者）通过信号量（m_queuestat）同步等待任务。
 // 当任务入队时，主线程调用sem_post增加信号量，唤醒一个阻塞在sem_wait的工作线程。
-//  子线程处理完HTTP解析（process()方法）后，会生成响应数据并存入写缓冲区，然后通过修改epoll事件为EPOLLOUT（例如调用modfd函数），触发主线程
-// 的写事件监听。主线程监听到可写事件后，调用write()方法完成数据发送。
+//  子线程处理完HTTP解析（process()方法）后，会生成响应数据并存入写缓冲区，然后直接尝试发送；只有套接字缓冲区满时才把epoll事件
+// 修改为EPOLLOUT（HTTPConn::rearm），由reactor监听到可写事件后调用write()方法继续发送。
 //  当任务队列满时（append()返回false），主线程应表示暂时无法完成请求任务。
+//
+// 工作窃取模式（USE_WORK_STEALING_QUEUE）：
+//  每个工作线程拥有一个收件箱（由该线程自己的锁保护，append只与目标线程竞争）和一个Chase-Lev双端队列。
+//  工作线程把收件箱中的任务批量转移到自己的双端队列中处理；自己的队列为空时，随机选择其他线程，
+//  从其双端队列的top端（或收件箱中）窃取任务，因此一个慢请求不会让排在它后面的任务一直等待。
+//  没有任务时线程通过eventfd挂起；append只在目标线程（或某个空闲线程）确实处于挂起状态时才写eventfd，
+//  而不是每个任务都post一次信号量。
+//
+// MPMC模式（USE_MPMC_QUEUE）：
+//  所有工作线程共享一个有界MPMC无锁队列（lockfree.h中的BlockingQueue_MPMC），多个sub reactor可以
+//  同时append而无需互斥锁；工作线程每次批量取出若干任务，只有队列为空时才在eventfd上挂起。
 
 #include <cstdint>
 #include <cstdio>
@@ -20,9 +31,17 @@
 
 // #define USE_LOCKFREE_QUEUE
 // #define USE_BOOST_LOCKFREE_QUEUE
+// #define USE_WORK_STEALING_QUEUE
+// #define USE_MPMC_QUEUE
 
 #ifdef USE_LOCKFREE_QUEUE
 #include "lockfree.h"
+#elif defined (USE_WORK_STEALING_QUEUE)
+#include <atomic>
+#include <deque>
+#include "lockfree.h"
+#elif defined (USE_MPMC_QUEUE)
+#include "lockfree.h"
 #elif defined (USE_BOOST_LOCKFREE_QUEUE)
 #include "boost/lockfree/policies.hpp"
 #include "boost/lockfree/queue.hpp"
@@ -39,6 +58,8 @@ public:
   ~ThreadPool();
   // 向请求队列中添加任务
   bool append(T *request);
+  // 第i个工作线程，用于设置CPU亲和性等线程属性
+  pthread_t thread(int i) const { return m_threads[i]; }
 
 private:
   static void *worker(void *arg);
@@ -58,6 +79,25 @@ private:
   LockFreeQueue_SPSC<T*>> m_lockfree_workq_set; // 无锁队列
 #elif defined (USE_BOOST_LOCKFREE_QUEUE)
   boost::lockfree::queue<T*, boost::lockfree::fixed_sized<true>> m_lockfree_workqueue;  // Boost库无锁队列 
+#elif defined (USE_MPMC_QUEUE)
+  static const int MPMC_POP_BATCH = 4;  // 每次最多取出的任务数，过大会让任务集中在少数线程上
+  BlockingQueue_MPMC<T*> m_mpmc_workqueue;
+#elif defined (USE_WORK_STEALING_QUEUE)
+  struct WSWorker {
+    WorkStealingDeque<T*> deque;  // 只有本线程push/pop，其他线程steal
+    locker inbox_lock;
+    std::deque<T*> inbox;         // append投递的任务
+    std::atomic<uint32_t> inbox_size{0};  // inbox的长度，在锁内更新，供其他线程不加锁地预判
+    event parker;                 // 挂起/唤醒
+    std::atomic<bool> parked{false};
+    char pad[64];
+  };
+  bool ws_try_steal(uint32_t thief, uint32_t& seed, T*& request);
+  void ws_wake(uint32_t target);
+  WSWorker* m_ws_workers;
+  uint32_t m_ws_inbox_cap;                  // 每个线程收件箱的最大任务数
+  std::atomic<uint32_t> m_ws_next{0};       // 投递目标，多个sub reactor可能同时append
+  std::atomic<int64_t> m_ws_pending{0};     // 尚未被取走的任务数，用于挂起前的检查
 #endif  // USE_LOCKFREE_QUEUE
 };
 
@@ -66,10 +106,12 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
     : m_thread_number(thread_number), m_max_requests(max_requests),
     m_threads(NULL), m_running(true)
 #ifdef USE_LOCKFREE_QUEUE
-       , m_lockfree_workq_set(thread_number) // empty
        , m_lf_queuestat(thread_number)
+       , m_lockfree_workq_set(thread_number) // empty
 #elif defined (USE_BOOST_LOCKFREE_QUEUE)
       , m_lockfree_workqueue(max_requests)  // 队列最大长度
+#elif defined (USE_MPMC_QUEUE)
+      , m_mpmc_workqueue(max_requests)      // 向上取整为2的幂
 #endif  // USE_LOCKFREE_QUEUE
       {
   if ((thread_number <= 0) || (max_requests <= 0)) {
@@ -85,6 +127,12 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
   for (int i = 0; i < thread_number; i++) {
     m_lockfree_workq_set[i].init_queue(max_requests);
   }
+#elif defined (USE_WORK_STEALING_QUEUE)
+  m_ws_inbox_cap = (max_requests + thread_number - 1) / thread_number;
+  m_ws_workers = new WSWorker[thread_number];
+  for (int i = 0; i < thread_number; i++) {
+    m_ws_workers[i].deque.init_queue(m_ws_inbox_cap);
+  }
 #endif
 
   // 创建thread_number个线程，并将它们都设置为脱离线程
@@ -105,6 +153,7 @@ ThreadPool<T>::ThreadPool(int thread_number, int max_requests)
 template <typename T> ThreadPool<T>::~ThreadPool() {
   delete[] m_threads;
   m_running = false;
+  // m_ws_workers不在这里释放：工作线程是脱离线程，可能仍阻塞在各自的eventfd上
 }
 #ifdef USE_LOCKFREE_QUEUE
 
@@ -144,6 +193,125 @@ template <typename T> void ThreadPool<T>::run([[maybe_unused]]int thread_id) {
     }
   }
 }
+#elif defined (USE_MPMC_QUEUE)
+template <typename T> bool ThreadPool<T>::append(T *request) {
+  return m_mpmc_workqueue.push(request);
+}
+
+template <typename T> void ThreadPool<T>::run([[maybe_unused]]int thread_id) {
+  T *requests[MPMC_POP_BATCH];
+  while (m_running) {
+    std::size_t n = m_mpmc_workqueue.pop_bulk_wait(requests, MPMC_POP_BATCH);
+    for (std::size_t i = 0; i < n; i++) {
+      requests[i]->process();
+    }
+  }
+}
+#elif defined (USE_WORK_STEALING_QUEUE)
+template <typename T> bool ThreadPool<T>::append(T *request) {
+  uint32_t target = m_ws_next.fetch_add(1, std::memory_order_relaxed) % m_thread_number;
+  WSWorker& w = m_ws_workers[target];
+  w.inbox_lock.lock();
+  // ------------- CRITICAL AREA --------
+  if (w.inbox.size() >= m_ws_inbox_cap) {
+    w.inbox_lock.unlock();
+    return false;
+  }
+  w.inbox.push_back(request);
+  w.inbox_size.store(w.inbox.size(), std::memory_order_relaxed);
+  // ------------- EXITING --------------
+  w.inbox_lock.unlock();
+  m_ws_pending.fetch_add(1, std::memory_order_seq_cst);
+  ws_wake(target);
+  return true;
+}
+
+// 唤醒目标线程；目标线程正忙时唤醒一个空闲线程来窃取
+template <typename T> void ThreadPool<T>::ws_wake(uint32_t target) {
+  if (m_ws_workers[target].parked.exchange(false, std::memory_order_seq_cst)) {
+    m_ws_workers[target].parker.post();
+    return;
+  }
+  for (uint32_t i = 1; i < m_thread_number; i++) {
+    WSWorker& w = m_ws_workers[(target + i) % m_thread_number];
+    if (w.parked.load(std::memory_order_relaxed) && w.parked.exchange(false, std::memory_order_seq_cst)) {
+      w.parker.post();
+      return;
+    }
+  }
+}
+
+// 从随机选择的其他线程处窃取一个任务，先尝试其双端队列，再尝试其收件箱
+template <typename T> bool ThreadPool<T>::ws_try_steal(uint32_t thief, uint32_t& seed, T*& request) {
+  // xorshift32
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  uint32_t start = seed % m_thread_number;
+  for (uint32_t i = 0; i < m_thread_number; i++) {
+    uint32_t victim = (start + i) % m_thread_number;
+    if (victim == thief) {
+      continue;
+    }
+    WSWorker& w = m_ws_workers[victim];
+    if (w.deque.steal(request)) {
+      return true;
+    }
+    if (w.inbox_size.load(std::memory_order_relaxed) > 0) {   // 不加锁的预判，只是为了避免无谓的加锁
+      w.inbox_lock.lock();
+      // ------------- CRITICAL AREA --------
+      bool got = !w.inbox.empty();
+      if (got) {
+        request = w.inbox.front();
+        w.inbox.pop_front();
+        w.inbox_size.store(w.inbox.size(), std::memory_order_relaxed);
+      }
+      // ------------- EXITING --------------
+      w.inbox_lock.unlock();
+      if (got) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+template <typename T> void ThreadPool<T>::run(int thread_id) {
+  WSWorker& self = m_ws_workers[thread_id];
+  uint32_t seed = 2463534242u + thread_id * 7919u;
+  T *request = nullptr;
+  while (m_running) {
+    if (self.deque.pop(request) || ws_try_steal(thread_id, seed, request)) {
+      m_ws_pending.fetch_sub(1, std::memory_order_relaxed);
+      request->process();
+      continue;
+    }
+    // 把收件箱中的任务批量转移到自己的双端队列，转移后其他线程即可窃取
+    bool moved = false;
+    self.inbox_lock.lock();
+    // ------------- CRITICAL AREA --------
+    while (!self.inbox.empty() && self.deque.push(self.inbox.front())) {
+      self.inbox.pop_front();
+      moved = true;
+    }
+    self.inbox_size.store(self.inbox.size(), std::memory_order_relaxed);
+    // ------------- EXITING --------------
+    self.inbox_lock.unlock();
+    if (moved) {
+      continue;
+    }
+
+    // 挂起：先声明挂起，再检查是否还有任务，与append中"先增加计数再检查挂起标志"配对，避免丢失唤醒
+    self.parked.store(true, std::memory_order_seq_cst);
+    if (m_ws_pending.load(std::memory_order_seq_cst) > 0) {
+      if (!self.parked.exchange(false, std::memory_order_seq_cst)) {
+        self.parker.wait();   // 已经有人post过，消耗掉这次唤醒
+      }
+      continue;
+    }
+    self.parker.wait();
+  }
+}
 #else // USE_LOCKFREE_QUEUE
 template <typename T> bool ThreadPool<T>::append(T *request) {
   m_qlock.lock();
@@ -0,0 +1,68 @@
+#ifndef TIMER_WHEEL_HEADER
+#define TIMER_WHEEL_HEADER
+
+// 哈希时间轮
+// 原理：每个sub reactor一个时间轮，共SLOTS个槽，每个槽对应TICK_MS毫秒，到期时间为t的节点放在 (t / TICK_MS) % SLOTS 号槽的双向链表中，
+//  所以设置和取消定时器都是O(1)的。reactor用epoll_wait的超时驱动时间轮，每次醒来处理从上次到现在经过的槽：
+//  槽中到期时间已过的节点被取出，超过一圈的节点（到期时间还没到）留在原处等下一圈。
+//  节点直接嵌在连接对象中，不需要额外分配内存。
+//  连接的定时器会被工作线程重新设置（例如处理完请求后设置keep-alive超时），所以时间轮用一把锁保护；
+//  同一个时间轮只被一个reactor及处理其连接的工作线程使用，竞争很小。
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "locker.h"
+
+class TimerWheel {
+public:
+    static const int TICK_MS = 100;
+    static const int SLOTS = 1024;      // 一圈约102秒
+    // 时间轮为空时epoll_wait的最长等待时间：其他线程可能在reactor阻塞期间加入新的定时器
+    static const int IDLE_POLL_MS = 1000;
+
+    struct Node {
+        Node* prev{NULL};
+        Node* next{NULL};
+        int64_t expire_ms{0};
+        void* owner{NULL};
+    };
+
+    // 到期检查：返回true表示节点确实到期；返回false时*next为重新设置的到期时间（-1表示不再设置）
+    typedef bool (*Check)(Node* node, int64_t now, int64_t* next);
+
+    TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // 设置（或重新设置）节点的到期时间
+    void arm(Node* node, int64_t expire_ms);
+    void cancel(Node* node);
+    // 处理到now为止的所有槽，确实到期的节点从时间轮中移除并放入out；check在持有锁时调用
+    void expire(int64_t now, Check check, std::vector<Node*>& out);
+    // 让调用者的一组操作相对于expire()中的检查是原子的（见HTTPConn::rearm）
+    void lock() { m_lock.lock(); }
+    void unlock() { m_lock.unlock(); }
+    // epoll_wait的超时时间（毫秒）
+    int next_timeout(int64_t now);
+
+    // 粗粒度单调时钟（vDSO实现，不陷入内核）
+    static int64_t now_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+private:
+    void link(Node* node);
+    void unlink(Node* node);
+
+    locker m_lock;
+    Node m_slots[SLOTS];    // 每个槽的链表头（哨兵节点）
+    int64_t m_current_tick; // 已经处理过的最后一个tick
+    size_t m_size;
+    std::vector<Node*> m_later;     // expire()中需要重新设置的节点
+};
+
+#endif
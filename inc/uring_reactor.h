@@ -0,0 +1,201 @@
+#ifndef URING_REACTOR_HEADER
+#define URING_REACTOR_HEADER
+
+// 基于io_uring的sub reactor（config中的use_io_uring）
+// 原理：epoll方式下一次请求往返需要epoll_wait、循环recv直到EAGAIN、至少两次epoll_ctl(MOD)以及writev/sendfile。
+//  这里每个sub reactor拥有一个io_uring（直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing）和自己的
+//  SO_REUSEPORT监听套接字，所有I/O都以SQE的形式提交，每轮循环只调用一次io_uring_enter同时完成提交和等待：
+//  - 监听套接字注册为固定文件，使用multishot accept，一个SQE持续产生新连接；
+//  - 每个连接注册到固定文件表中（下标即fd，FILES_UPDATE与第一个recv链接提交），之后的操作不再需要查找fd；
+//  - 接收使用multishot recv + 内核选择的缓冲区（provided buffer ring），内核直接把数据放入reactor注册的缓冲区中，
+//    连接不需要在等待数据时占用缓冲区；
+//  - 发送使用sendmsg(MSG_WAITALL)一次提交整批管线化响应，需要关闭连接时链接一个shutdown；
+//  - 关闭时先取消连接上未完成的操作，全部完成后再提交FILES_UPDATE(-1)和close，不额外产生系统调用。
+//  HTTPConn的状态机不变：epoll方式下的rearm(EPOLLIN/EPOLLOUT)变为通知reactor，工作线程通过无锁队列+eventfd通知，
+//  reactor线程自身的通知在本轮循环结束前处理；收到的数据复制到连接的读缓冲区，交给同一套解析代码。
+//  一个连接同一时间只由reactor或一个工作线程处理：连接不处于等待数据状态时收到的数据暂存在其占用的缓冲区中，
+//  等连接回到等待数据状态时再交给它。
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <vector>
+#include <linux/io_uring.h>
+
+#include "locker.h"
+#include "lockfree.h"
+#include "buffer_pool.h"
+#include "timer_wheel.h"
+
+class HTTPConn;
+
+class UringReactor {
+public:
+    static const unsigned SQ_ENTRIES = 1024;
+    static const unsigned CQ_ENTRIES = 4096;
+    // provided buffer ring：BUF_COUNT个BUF_SIZE字节的接收缓冲区
+    static const unsigned BUF_COUNT = 256;
+    static const unsigned BUF_SIZE = 4096;
+    static const int BUF_GROUP = 0;
+    // 连接不处于等待数据状态时最多暂存的缓冲区数，达到后暂停它的recv，防止一个连接占用所有缓冲区
+    static const int MAX_HELD_BUFS = 4;
+    // 一次sendmsg最多的iovec数，与HTTPConn::MAX_PIPELINE_DEPTH对应
+    static const int MAX_SEND_IOV = 64;
+
+    // 请求已读入连接的读缓冲区，需要处理（对应server.cpp中的dispatch_request）
+    typedef void (*Dispatch)(HTTPConn* conn, void* arg);
+
+    struct Stats {
+        uint64_t enters;    // io_uring_enter调用次数
+        uint64_t sqes;      // 提交的SQE数
+        uint64_t cqes;      // 处理的CQE数
+    };
+
+    UringReactor(HTTPConn* users, int max_fd, BufferPool* pool, TimerWheel* timers);
+    ~UringReactor();
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    // 在reactor线程中调用：创建io_uring并注册缓冲区和固定文件，内核不支持时返回false（调用者退回epoll）
+    bool init(int listenfd);
+    // 事件循环，不返回
+    void run(Dispatch dispatch, void* arg);
+
+    // 代替modfd：连接需要继续接收（EPOLLIN）或发送（EPOLLOUT），可以在工作线程中调用
+    void rearm(int fd, int ev);
+    // 关闭连接前调用：没有未完成的操作时返回true；否则取消这些操作并返回false，全部完成后reactor再次调用close_conn
+    bool detach(int fd);
+    // 从固定文件表中移除并关闭fd
+    void close_fd(int fd);
+
+    Stats stats() const;
+
+private:
+    // 连接在reactor中的状态
+    enum SLOT_STATE {
+        SLOT_FREE = 0,
+        SLOT_READING,   // 等待数据，收到的数据直接交给连接
+        SLOT_BUSY,      // 正在解析/处理（工作线程或run-to-completion）
+        SLOT_SENDING,   // sendmsg已提交
+        SLOT_CLOSING    // 正在取消未完成的操作
+    };
+    // user_data的高32位
+    enum OP {
+        OP_IGNORE = 0, OP_ACCEPT, OP_RECV, OP_SEND, OP_EVENT
+    };
+
+    // 一次sendmsg的参数，提交后直到完成都需要保持有效，从内存池借用
+    struct SendReq {
+        struct msghdr msg;
+        struct iovec iov[MAX_SEND_IOV];
+    };
+
+    struct Slot {
+        uint8_t state;
+        uint8_t inflight;   // 完成前会产生CQE、并且引用连接资源的操作数（recv、send）
+        bool recv_armed;
+        bool recv_paused;   // 暂存的缓冲区达到MAX_HELD_BUFS，已提交取消recv
+        bool eof;           // 连接不处于READING时收到了EOF或错误
+        bool ready;         // 已在m_ready中
+        bool shutdown_linked;
+        uint32_t gen;       // 每次关闭加一，用于丢弃过期的rearm
+        int head;           // 暂存的接收缓冲区链表（bid + 1，0表示空）
+        int tail;
+        int held;           // 暂存的缓冲区数
+        int fd_value;       // FILES_UPDATE的参数，需要在提交后保持有效
+        SendReq* send;
+    };
+    struct Rearm {
+        int fd;
+        int ev;
+        uint32_t gen;
+    };
+
+    struct io_uring_sqe* get_sqe();
+    int enter(unsigned to_submit, unsigned min_complete, int timeout_ms);
+    bool setup_ring();
+    bool setup_buffers();
+    void setup_files();
+    bool fixed(int fd) const {
+        return fd >= 0 && fd < m_files;
+    }
+
+    void arm_accept();
+    void arm_event();
+    void arm_recv(int fd);
+    void pause_recv(int fd);
+    bool wants_recv(const Slot& s) const {
+        return s.state == SLOT_READING ||
+               ((s.state == SLOT_BUSY || s.state == SLOT_SENDING) && s.held < MAX_HELD_BUFS);
+    }
+    void submit_send(int fd);
+    void recycle(int bid);
+    void publish_buffers();
+
+    void on_cqe(const struct io_uring_cqe* cqe);
+    void on_accept(int res, uint32_t flags);
+    void on_recv(int fd, int res, uint32_t flags);
+    void on_send(int fd, int res);
+    void on_rearm(const Rearm& r);
+    void deliver(int fd);
+    void mark_ready(int fd);
+    void dispatch_ready();
+    void retry_starved();
+    void close_conn(int fd);
+    void maybe_finish_close(int fd);
+
+    HTTPConn* m_users;
+    int m_max_fd;
+    BufferPool* m_pool;
+    TimerWheel* m_timers;
+    Dispatch m_dispatch{NULL};
+    void* m_dispatch_arg{NULL};
+    int m_listenfd{-1};
+    bool m_listen_fixed{false};
+
+    // io_uring共享内存
+    int m_ring_fd{-1};
+    void* m_sq_ptr{NULL};
+    size_t m_sq_size{0};
+    void* m_cq_ptr{NULL};
+    size_t m_cq_size{0};
+    struct io_uring_sqe* m_sqes{NULL};
+    size_t m_sqes_size{0};
+    unsigned* m_sq_khead;
+    unsigned* m_sq_ktail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned m_sq_tail{0};      // 本地尾指针，io_uring_enter前发布
+    unsigned m_sq_submitted{0};
+    unsigned* m_cq_khead;
+    unsigned* m_cq_ktail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe* m_cqes;
+
+    // provided buffer ring
+    struct io_uring_buf* m_br{NULL};
+    size_t m_br_size{0};
+    char* m_bufs{NULL};
+    uint16_t m_br_tail{0};
+    unsigned m_free_bufs{0};    // 当前在ring中可供内核使用的缓冲区数
+    int m_buf_next[BUF_COUNT];  // 暂存链表
+    int m_buf_len[BUF_COUNT];
+
+    int m_files{0};             // 固定文件表大小，fd小于它的连接使用固定文件
+
+    Slot* m_slots{NULL};
+    std::vector<int> m_ready;           // 已收到数据、等待交给dispatch的连接
+    std::vector<int> m_starved;         // 因缓冲区用尽而停止的recv
+    std::vector<Rearm> m_local;         // reactor线程自身发出的rearm
+    LockFreeQueue_MPMC<Rearm> m_remote; // 工作线程发出的rearm
+    event m_wakeup_event;
+    std::atomic_bool m_wakeup{false};
+    uint64_t m_event_val{0};
+
+    std::atomic<uint64_t> m_enters{0};
+    std::atomic<uint64_t> m_sqe_count{0};
+    std::atomic<uint64_t> m_cqe_count{0};
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "access_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+AccessLog access_log;
+
+__thread AccessLog::Ring* AccessLog::t_ring = NULL;
+
+// 与HTTPConn::METHOD、HTTPConn::HTTP_VERSION一一对应
+static const char* const METHOD_NAMES[] = {
+    "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"
+};
+static const char* const VERSION_NAMES[] = {
+    "HTTP/1.0", "HTTP/1.1", "HTTP/2.0"
+};
+// 一行文本的最大长度（URL最多URL_MAX字节，其余字段长度固定）
+static const size_t LINE_MAX_LEN = 512;
+
+size_t format_access_record(const AccessRecord& r, char* buf, size_t size) {
+    // 日期部分每秒才变化一次，每个线程缓存格式化好的结果
+    static __thread time_t t_sec = -1;
+    static __thread char t_date[32];
+    time_t sec = (time_t)(r.time_us / 1000000);
+    if (sec != t_sec) {
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        strftime(t_date, sizeof(t_date), "%d/%b/%Y:%H:%M:%S", &tm);
+        t_sec = sec;
+    }
+    char addr[INET_ADDRSTRLEN];
+    struct in_addr in;
+    in.s_addr = r.client_addr;
+    inet_ntop(AF_INET, &in, addr, sizeof(addr));
+    const char* method = r.method < sizeof(METHOD_NAMES) / sizeof(METHOD_NAMES[0]) ? METHOD_NAMES[r.method] : "-";
+    const char* version = r.version < sizeof(VERSION_NAMES) / sizeof(VERSION_NAMES[0]) ? VERSION_NAMES[r.version] : "-";
+    int url_len = r.url_len < AccessRecord::URL_MAX ? r.url_len : AccessRecord::URL_MAX;
+    int n;
+    if (r.url_len == 0) {
+        // 请求行无法解析
+        n = snprintf(buf, size, "%s:%u - - [%s.%06u +0000] \"-\" %u %llu %uus\n",
+                     addr, ntohs(r.client_port), t_date, (unsigned)(r.time_us % 1000000),
+                     r.status, (unsigned long long)r.bytes, r.duration_us);
+    } else {
+        // 截断的URL以"..."结尾
+        n = snprintf(buf, size, "%s:%u - - [%s.%06u +0000] \"%s %.*s%s %s\" %u %llu %uus\n",
+                     addr, ntohs(r.client_port), t_date, (unsigned)(r.time_us % 1000000),
+                     method, url_len, r.url, r.url_len > url_len ? "..." : "", version,
+                     r.status, (unsigned long long)r.bytes, r.duration_us);
+    }
+    if (n < 0) {
+        return 0;
+    }
+    return (size_t)n < size ? (size_t)n : size - 1;
+}
+
+bool AccessLog::open(const char* path, bool binary, int ring_size) {
+    if (strlen(path) >= sizeof(m_path)) {
+        fprintf(stderr, "access log: path too long: %s\n", path);
+        return false;
+    }
+    strcpy(m_path, path);
+    m_binary = binary;
+    // LockFreeQueue_SPSC预留一个位置区分空与满
+    m_ring_size = (ring_size > 1 ? ring_size : 1) + 1;
+    if (!open_file()) {
+        return false;
+    }
+    m_stop.store(false);
+    if (pthread_create(&m_thread, NULL, writer, this) != 0) {
+        perror("access log: unable to start writer thread");
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_enabled = true;
+    return true;
+}
+
+void AccessLog::close() {
+    if (!m_enabled) {
+        return;
+    }
+    // 之后的记录不再写入；已注册的队列不释放，其他线程此时可能仍在入队
+    m_enabled = false;
+    m_stop.store(true, std::memory_order_release);
+    pthread_join(m_thread, NULL);
+    ::close(m_fd);
+    m_fd = -1;
+}
+
+AccessLog::Ring* AccessLog::register_thread() {
+    Ring* ring = new Ring(m_ring_size);
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    m_rings.push_back(ring);
+    // ------------- EXITING --------------
+    m_lock.unlock();
+    return ring;
+}
+
+bool AccessLog::open_file() {
+    m_fd = ::open(m_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        fprintf(stderr, "access log: unable to open %s: %s\n", m_path, strerror(errno));
+        return false;
+    }
+    if (m_binary && lseek(m_fd, 0, SEEK_END) == 0) {
+        // 新文件：先写文件头
+        AccessLogHeader h;
+        memcpy(h.magic, ACCESS_LOG_MAGIC, sizeof(h.magic));
+        h.version = ACCESS_LOG_VERSION;
+        h.record_size = sizeof(AccessRecord);
+        write_out((const char*)&h, sizeof(h));
+    }
+    return true;
+}
+
+void AccessLog::write_out(const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(m_fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 磁盘满等错误：丢弃这一批，不影响服务
+            perror("access log: write");
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+void* AccessLog::writer(void* arg) {
+    ((AccessLog*)arg)->run();
+    return NULL;
+}
+
+void AccessLog::run() {
+    char* buf = new char[WRITE_BUF_SIZE];
+    while (!m_stop.load(std::memory_order_acquire)) {
+        if (m_reopen.exchange(false, std::memory_order_relaxed)) {
+            int old_fd = m_fd;
+            if (open_file()) {
+                ::close(old_fd);
+            } else {
+                m_fd = old_fd;
+            }
+        }
+        // 记录较少时攒一段时间再写，避免每条记录一次write
+        if (!drain(buf)) {
+            usleep(IDLE_SLEEP_US);
+        }
+    }
+    drain(buf);
+    delete[] buf;
+}
+
+bool AccessLog::drain(char* buf) {
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    m_snapshot = m_rings;
+    // ------------- EXITING --------------
+    m_lock.unlock();
+    bool busy = false;
+    size_t len = 0;
+    AccessRecord r;
+    for (size_t i = 0; i < m_snapshot.size(); i++) {
+        // 取出时已超过一半容量的队列，在休眠期间可能被填满
+        int n = 0;
+        while (m_snapshot[i]->pop(r)) {
+            if (++n * 2 >= m_ring_size) {
+                busy = true;
+            }
+            if (WRITE_BUF_SIZE - len < LINE_MAX_LEN) {
+                write_out(buf, len);
+                len = 0;
+                busy = true;
+            }
+            if (m_binary) {
+                memcpy(buf + len, &r, sizeof(r));
+                len += sizeof(r);
+            } else {
+                len += format_access_record(r, buf + len, WRITE_BUF_SIZE - len);
+            }
+        }
+    }
+    if (len > 0) {
+        write_out(buf, len);
+    }
+    return busy;
+}
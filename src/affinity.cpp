@@ -0,0 +1,122 @@
+#include "affinity.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+bool parse_cpu_list(const char* text, std::vector<int>& cpus) {
+    cpus.clear();
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE) {
+                return false;
+            }
+            p = end;
+        }
+        for (long c = first; c <= last; c++) {
+            cpus.push_back((int)c);
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+    std::string s;
+    size_t i = 0;
+    while (i < cpus.size()) {
+        // 连续递增的一段写成first-last
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+        if (!s.empty()) {
+            s += ',';
+        }
+        s += std::to_string(cpus[i]);
+        if (j > i) {
+            s += '-';
+            s += std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return s;
+}
+
+bool pin_thread(pthread_t thread, const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+int cpu_node(int cpu) {
+    // /sys/devices/system/cpu/cpuN/下有一个指向所在节点的nodeX链接
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        char* end;
+        if (strncmp(ent->d_name, "node", 4) == 0) {
+            long n = strtol(ent->d_name + 4, &end, 10);
+            if (end != ent->d_name + 4 && *end == '\0') {
+                node = (int)n;
+                break;
+            }
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+bool node_cpus(int node, std::vector<int>& cpus) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), fp) != NULL;
+    fclose(fp);
+    if (!ok) {
+        return false;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    return parse_cpu_list(line, cpus) && !cpus.empty();
+}
+
+bool prefer_node(void* addr, size_t len, int node) {
+    static const int MAX_NODES = 1024;
+    unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    if (node < 0 || node >= MAX_NODES) {
+        return false;
+    }
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    // glibc没有mbind的封装（在libnuma中），直接使用系统调用；maxnode按内核的约定多传一位
+    return syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, MAX_NODES + 1, 0) == 0;
+}
@@ -0,0 +1,91 @@
+#include "buffer_pool.h"
+#include <stdio.h>
+#include <sys/mman.h>
+#include "affinity.h"
+
+BufferPool::BufferPool() : m_slab_bytes(0), m_in_use_bytes(0), m_node(-1) {
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        m_free[i] = NULL;
+    }
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < m_slabs.size(); i++) {
+        munmap(m_slabs[i], SLAB_SIZE);
+    }
+}
+
+int BufferPool::class_of(size_t size) {
+    int cls = 0;
+    while (cls < NUM_CLASSES && ((size_t)1 << (MIN_SHIFT + cls)) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+// 申请一个slab并切分为cls等级的块，调用时已持有锁
+bool BufferPool::refill(int cls) {
+    void* slab = mmap(NULL, SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+        perror("BufferPool mmap");
+        return false;
+    }
+    if (m_node >= 0) {
+        // 失败时（非NUMA内核）按默认策略分配
+        prefer_node(slab, SLAB_SIZE, m_node);
+    }
+    m_slabs.push_back(slab);
+    m_slab_bytes += SLAB_SIZE;
+    size_t chunk = (size_t)1 << (MIN_SHIFT + cls);
+    char* base = (char*)slab;
+    // 倒序插入，使链表中的块按地址递增
+    for (size_t off = SLAB_SIZE; off >= chunk; off -= chunk) {
+        FreeChunk* c = (FreeChunk*)(base + off - chunk);
+        c->next = m_free[cls];
+        m_free[cls] = c;
+    }
+    return true;
+}
+
+char* BufferPool::alloc(size_t size) {
+    int cls = class_of(size);
+    if (cls >= NUM_CLASSES) {
+        return NULL;
+    }
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    if (!m_free[cls] && !refill(cls)) {
+        m_lock.unlock();
+        return NULL;
+    }
+    FreeChunk* c = m_free[cls];
+    m_free[cls] = c->next;
+    m_in_use_bytes += (size_t)1 << (MIN_SHIFT + cls);
+    // ------------- EXITING --------------
+    m_lock.unlock();
+    return (char*)c;
+}
+
+void BufferPool::free(char* buf, size_t size) {
+    if (!buf) {
+        return;
+    }
+    int cls = class_of(size);
+    FreeChunk* c = (FreeChunk*)buf;
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    c->next = m_free[cls];
+    m_free[cls] = c;
+    m_in_use_bytes -= (size_t)1 << (MIN_SHIFT + cls);
+    // ------------- EXITING --------------
+    m_lock.unlock();
+}
+
+BufferPool::Stats BufferPool::stats() {
+    Stats s;
+    m_lock.lock();
+    s.slab_bytes = m_slab_bytes;
+    s.in_use_bytes = m_in_use_bytes;
+    m_lock.unlock();
+    return s;
+}
@@ -1,5 +1,12 @@
 #include "config.h"
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <strings.h>
+
+std::atomic<const Config*> g_live_cfg(&cfg);
 
 // default config
 Config::Config() {
@@ -9,8 +16,252 @@ Config::Config() {
 void Config::init_default() {
     sub_reactors = 1;
     worker_threads = 1;
+    // 线程池队列中最多等待的任务数，超过时返回503
+    max_requests = 1000;
     use_sendfile = false;
+    // 在sub reactor线程内直接处理请求，只有需要阻塞操作时才交给线程池
+    run_to_completion = false;
+    // 单个请求（请求行+头部+消息体）的最大字节数，读缓冲区从2KB开始按需扩大到这个值
+    max_request_size = 16384;
+    // 读/写缓冲区的初始大小（字节），按内存池的大小等级（1KB~64KB的2的幂）向上取整
+    read_buffer_size = 2048;
+    write_buffer_size = 1024;
+    // 一次最多解析并批量发送的管线化请求数
+    pipeline_depth = 16;
+    // 每次epoll_wait最多取回的事件数
+    max_events = 1024;
+    // 连接超时（秒），0表示不限制：
+    //  header_timeout为从连接建立或请求开始到请求头接收完整的时间；keepalive_timeout为两个请求之间的空闲时间；
+    //  write_timeout为响应发送停滞（对端不读取）的时间
+    header_timeout = 15;
+    keepalive_timeout = 60;
+    write_timeout = 30;
+    // 每个连接每次被reactor处理时最多发送的字节数（KB），用完后排到就绪列表末尾，等同一reactor上的其他连接处理完再继续；
+    //  防止大文件下载长时间占用reactor线程，0表示不限制
+    write_budget = 256;
+
+    // 打开文件缓存，ttl单位为秒，0表示仅依赖inotify失效
+    use_file_cache = true;
+    file_cache_shards = 16;
+    file_cache_entries = 4096;
+    file_cache_ttl = 60;
+
+    // 小文件内容缓存，max_file单位为字节，size（总内存预算）单位为KB
+    use_content_cache = true;
+    content_cache_max_file = 16384;
+    content_cache_size = 65536;
+
+    // 在/__stats（JSON）和/__stats/prometheus上提供运行统计；与普通页面使用同一个端口，默认关闭
+    enable_stats = false;
 
     listen_port = 1234;
+    // listen()的backlog（还受内核somaxconn限制），重新加载时对已有的监听套接字再次调用listen()生效
+    listen_backlog = 100;
+    // 发送策略，设置在监听套接字上，之后接受的连接继承（重新加载时对已有的监听套接字重新设置）：
+    //  tcp_nodelay关闭Nagle算法，小响应立即发出；响应头与sendfile的响应体由MSG_MORE合并为同一个报文段，不依赖Nagle
+    //  tcp_notsent_lowat（KB）：内核中尚未发出的数据超过该值时套接字不可写，避免每个连接在内核中积压数MB，0表示系统默认
+    //  send_buffer_size（KB）：SO_SNDBUF，设置后内核不再自动调整，0表示自动调整
+    tcp_nodelay = true;
+    tcp_notsent_lowat = 128;
+    send_buffer_size = 0;
+    // 每个sub reactor使用自己的SO_REUSEPORT监听套接字，cbpf表示按接收CPU选择套接字（需要用sub_reactor_cpus把每个sub reactor绑定到不同的CPU）
+    reuseport = false;
+    reuseport_cbpf = false;
+    // sub reactor使用io_uring代替epoll（隐含reuseport，每个sub reactor拥有自己的监听套接字），内核不支持时退回epoll
+    use_io_uring = false;
     strcpy(this->listen_intf, "0.0.0.0");
+    // 网站的根目录
+    strcpy(this->doc_root, "/var/www/html");
+
+    // 线程绑核，CPU列表格式与taskset -c相同（如"0-3,8"），空表示不绑定：
+    //  main_reactor_cpus为主反应堆可用的CPU；第i个sub reactor/工作线程绑定到列表中的第(i % 列表长度)个CPU
+    //  sub reactor的连接对象和缓冲区优先从它所在的NUMA节点分配
+    this->main_reactor_cpus[0] = '\0';
+    this->sub_reactor_cpus[0] = '\0';
+    this->worker_cpus[0] = '\0';
+    // worker_cpus为空时，第i个工作线程绑定到第(i % sub_reactors)个sub reactor所在NUMA节点的全部CPU上
+    colocate_workers = false;
+
+    // 访问日志文件，空表示不记录；binary为紧凑的二进制格式（用bin/access_log_decode转换为文本）
+    // ring为每个线程的日志队列容量（条），后台线程来不及写出时新的记录被丢弃
+    this->access_log[0] = '\0';
+    access_log_binary = false;
+    access_log_ring = 4096;
+}
+
+// 各类型成员的值解析
+static bool parse_value(const char* text, int* out) {
+    char* end;
+    errno = 0;
+    long v = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || v < INT_MIN || v > INT_MAX) {
+        return false;
+    }
+    *out = (int)v;
+    return true;
+}
+
+static bool parse_value(const char* text, bool* out) {
+    static const char* const yes[] = { "true", "yes", "on", "1" };
+    static const char* const no[] = { "false", "no", "off", "0" };
+    for (size_t i = 0; i < sizeof(yes) / sizeof(yes[0]); i++) {
+        if (strcasecmp(text, yes[i]) == 0) {
+            *out = true;
+            return true;
+        }
+        if (strcasecmp(text, no[i]) == 0) {
+            *out = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_value(const char* text, char* out, size_t size) {
+    size_t len = strlen(text);
+    if (len >= size) {
+        return false;
+    }
+    memcpy(out, text, len + 1);
+    return true;
+}
+
+// 去掉首尾空白，返回第一个非空白字符
+static char* trim(char* s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    char* end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) {
+        *--end = '\0';
+    }
+    return s;
+}
+
+// int成员的取值范围，读取配置文件后检查；不在表中的成员不限制
+// 以KB为单位的成员上限保证乘以1024后不溢出int（setsockopt的参数是int）
+static const struct {
+    const char* name;
+    int Config::* member;
+    int min;
+    int max;
+} INT_RANGES[] = {
+    { "sub_reactors",           &Config::sub_reactors,           1, 1024 },
+    { "worker_threads",         &Config::worker_threads,         1, 1024 },
+    { "max_requests",           &Config::max_requests,           1, INT_MAX },
+    { "max_request_size",       &Config::max_request_size,       1, INT_MAX },
+    { "read_buffer_size",       &Config::read_buffer_size,       1, INT_MAX },
+    { "write_buffer_size",      &Config::write_buffer_size,      1, INT_MAX },
+    { "pipeline_depth",         &Config::pipeline_depth,         1, INT_MAX },
+    { "max_events",             &Config::max_events,             1, 65536 },
+    { "header_timeout",         &Config::header_timeout,         0, 86400 },
+    { "keepalive_timeout",      &Config::keepalive_timeout,      0, 86400 },
+    { "write_timeout",          &Config::write_timeout,          0, 86400 },
+    { "write_budget",           &Config::write_budget,           0, INT_MAX / 1024 },
+    { "listen_port",            &Config::listen_port,            1, 65535 },
+    { "listen_backlog",         &Config::listen_backlog,         1, INT_MAX },
+    { "tcp_notsent_lowat",      &Config::tcp_notsent_lowat,      0, INT_MAX / 1024 },
+    { "send_buffer_size",       &Config::send_buffer_size,       0, INT_MAX / 1024 },
+    { "file_cache_shards",      &Config::file_cache_shards,      1, 1024 },
+    { "file_cache_entries",     &Config::file_cache_entries,     1, INT_MAX },
+    { "file_cache_ttl",         &Config::file_cache_ttl,         0, INT_MAX },
+    { "content_cache_max_file", &Config::content_cache_max_file, 0, INT_MAX },
+    { "content_cache_size",     &Config::content_cache_size,     0, INT_MAX / 1024 },
+    { "access_log_ring",        &Config::access_log_ring,        1, 1 << 24 },
+};
+
+bool Config::load_from(const char* config_path) {
+    FILE* fp = fopen(config_path, "r");
+    if (!fp) {
+        fprintf(stderr, "config: unable to open %s: %s\n", config_path, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    char line[512];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        char* key = trim(line);
+        if (*key == '\0') {
+            continue;
+        }
+        char* eq = strchr(key, '=');
+        if (!eq) {
+            fprintf(stderr, "config: %s:%d: expected key = value\n", config_path, lineno);
+            ok = false;
+            continue;
+        }
+        *eq = '\0';
+        char* value = trim(eq + 1);
+        key = trim(key);
+        // 按成员名逐个比较，成员列表与结构体定义来自同一个X-macro
+        bool known = false;
+        bool valid = false;
+        #define X(type, name, live) \
+            if (!known && strcmp(key, #name) == 0) { \
+                known = true; \
+                valid = parse_value(value, &name); \
+            }
+        #define X_ARRAY(type, name, size, live) \
+            if (!known && strcmp(key, #name) == 0) { \
+                known = true; \
+                valid = parse_value(value, name, size); \
+            }
+        CONFIG_MEMBERS
+        #undef X
+        #undef X_ARRAY
+        if (!known) {
+            fprintf(stderr, "config: %s:%d: unknown key '%s'\n", config_path, lineno, key);
+            ok = false;
+        } else if (!valid) {
+            fprintf(stderr, "config: %s:%d: invalid value '%s' for %s\n", config_path, lineno, value, key);
+            ok = false;
+        }
+    }
+    fclose(fp);
+    for (size_t i = 0; i < sizeof(INT_RANGES) / sizeof(INT_RANGES[0]); i++) {
+        int v = this->*INT_RANGES[i].member;
+        if (v < INT_RANGES[i].min || v > INT_RANGES[i].max) {
+            fprintf(stderr, "config: %s: %s = %d is out of range [%d, %d]\n", config_path,
+                    INT_RANGES[i].name, v, INT_RANGES[i].min, INT_RANGES[i].max);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+const Config* reload_config(const char* config_path) {
+    const Config& cur = live_cfg();
+    // 从默认值开始，配置文件中删除的项恢复默认
+    Config* next = new Config();
+    if (!next->load_from(config_path)) {
+        delete next;
+        return NULL;
+    }
+    // 需要重启的成员保持当前值；命令行参数只影响这类成员，所以也不会被配置文件覆盖
+    // 只有配置文件把它们改成了非默认值时才提示（未写在文件中的项不提示）
+    const Config defaults;
+    #define X(type, name, live) \
+        if (!live) { \
+            if (next->name != cur.name && next->name != defaults.name) { \
+                std::cerr << "config: " #name " requires a restart, keeping " << cur.name << '\n'; \
+            } \
+            next->name = cur.name; \
+        }
+    #define X_ARRAY(type, name, size, live) \
+        if (!live) { \
+            if (strcmp(next->name, cur.name) != 0 && strcmp(next->name, defaults.name) != 0) { \
+                std::cerr << "config: " #name " requires a restart, keeping \"" << cur.name << "\"\n"; \
+            } \
+            memcpy(next->name, cur.name, sizeof(next->name)); \
+        }
+    CONFIG_MEMBERS
+    #undef X
+    #undef X_ARRAY
+    g_live_cfg.store(next, std::memory_order_release);
+    return next;
 }
\ No newline at end of file
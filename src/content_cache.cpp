@@ -0,0 +1,169 @@
+#include "content_cache.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+ContentCache content_cache;
+
+ContentCache::ContentCache()
+    : m_enabled(false), m_shards(NULL), m_shard_mask(0), m_max_file_size(0), m_shard_budget(0),
+      m_evictions(0) {
+}
+
+ContentCache::~ContentCache() {
+    if (m_shards) {
+        for (uint32_t i = 0; i <= m_shard_mask; i++) {
+            for (size_t j = 0; j < m_shards[i].ring.size(); j++) {
+                release(m_shards[i].ring[j]);
+            }
+        }
+        delete[] m_shards;
+    }
+}
+
+void ContentCache::init(bool enabled, int shards, size_t max_file_size, size_t budget) {
+    m_enabled = enabled && max_file_size > 0 && budget > 0;
+    m_max_file_size = max_file_size;
+    if (!m_enabled) {
+        return;
+    }
+    uint32_t n = 1;
+    while ((int)n < shards) {
+        n <<= 1;
+    }
+    m_shard_mask = n - 1;
+    m_shards = new Shard[n];
+    for (uint32_t i = 0; i < n; i++) {
+        m_shards[i].hand = 0;
+        m_shards[i].used = 0;
+    }
+    m_shard_budget = budget / n;
+}
+
+ContentCache::Entry* ContentCache::acquire(const FileCache::Entry* file, bool linger, bool encoded, bool vary) {
+    Key key = make_key(file, linger, encoded, vary);
+    Shard& shard = shard_of(key);
+    shard.lock.lock();
+    // ------------- CRITICAL AREA --------
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        shard.lock.unlock();
+        metrics.add(Metrics::CONTENT_CACHE_MISSES);
+        return NULL;
+    }
+    Entry* entry = it->second;
+    entry->referenced = true;
+    entry->refs.fetch_add(1, std::memory_order_relaxed);
+    // ------------- EXITING --------------
+    shard.lock.unlock();
+    metrics.add(Metrics::CONTENT_CACHE_HITS);
+    return entry;
+}
+
+// CLOCK淘汰，直到分片中能放下need字节
+void ContentCache::evict_locked(Shard& shard, size_t need) {
+    while (!shard.ring.empty() && shard.used + need > m_shard_budget) {
+        if (shard.hand >= shard.ring.size()) {
+            shard.hand = 0;
+        }
+        Entry* victim = shard.ring[shard.hand];
+        if (victim->referenced) {
+            // 第二次机会
+            victim->referenced = false;
+            shard.hand++;
+            continue;
+        }
+        shard.ring[shard.hand] = shard.ring.back();
+        shard.ring.pop_back();
+        shard.map.erase(victim->key);
+        shard.used -= victim->charge;
+        m_evictions.fetch_add(1, std::memory_order_relaxed);
+        release(victim);
+    }
+}
+
+ContentCache::Entry* ContentCache::insert(const FileCache::Entry* file, bool linger, bool encoded, bool vary,
+                                         const char* header, size_t header_len) {
+    size_t body_len = file->st.st_size;
+    size_t len = header_len + body_len;
+    size_t charge = len + sizeof(Entry);
+    if (charge > m_shard_budget) {
+        return NULL;
+    }
+
+    // 在锁外读取文件内容，使用pread避免改动共享fd的文件偏移
+    char* data = (char*)malloc(len);
+    if (!data) {
+        return NULL;
+    }
+    memcpy(data, header, header_len);
+    size_t done = 0;
+    while (done < body_len) {
+        ssize_t n = pread(file->fd, data + header_len + done, body_len - done, done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // 文件被截断或读取出错，不缓存
+            free(data);
+            return NULL;
+        }
+        done += n;
+    }
+
+    Entry* entry = new Entry;
+    entry->data = data;
+    entry->len = len;
+    entry->charge = charge;
+    entry->key = make_key(file, linger, encoded, vary);
+    entry->referenced = false;
+    entry->refs.store(2, std::memory_order_relaxed);   // 缓存自身和调用者各一个引用
+
+    Shard& shard = shard_of(entry->key);
+    shard.lock.lock();
+    // ------------- CRITICAL AREA --------
+    auto it = shard.map.find(entry->key);
+    if (it != shard.map.end()) {
+        // 其他线程已经插入了相同的内容，直接使用已有条目
+        Entry* exist = it->second;
+        exist->referenced = true;
+        exist->refs.fetch_add(1, std::memory_order_relaxed);
+        shard.lock.unlock();
+        entry->refs.store(1, std::memory_order_relaxed);
+        release(entry);
+        return exist;
+    }
+    evict_locked(shard, charge);
+    shard.map.emplace(entry->key, entry);
+    shard.ring.push_back(entry);
+    shard.used += charge;
+    // ------------- EXITING --------------
+    shard.lock.unlock();
+    return entry;
+}
+
+void ContentCache::release(Entry* entry) {
+    if (entry && entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        free(entry->data);
+        delete entry;
+    }
+}
+
+ContentCache::Stats ContentCache::stats() const {
+    Stats s;
+    s.hits = metrics.total(Metrics::CONTENT_CACHE_HITS);
+    s.misses = metrics.total(Metrics::CONTENT_CACHE_MISSES);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+    s.bytes = 0;
+    if (m_shards) {
+        for (uint32_t i = 0; i <= m_shard_mask; i++) {
+            m_shards[i].lock.lock();
+            s.bytes += m_shards[i].used;
+            m_shards[i].lock.unlock();
+        }
+    }
+    return s;
+}
@@ -0,0 +1,378 @@
+#include "file_cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "metrics.h"
+
+FileCache file_cache;
+
+// 粗粒度单调时钟（vDSO实现，不陷入内核），精度足够用于TTL
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+FileCache::FileCache()
+    : m_enabled(false), m_shards(NULL), m_shard_mask(0), m_shard_capacity(0), m_ttl_ms(0),
+      m_generation(0), m_evictions(0), m_inotify_fd(-1) {
+}
+
+FileCache::~FileCache() {
+    if (m_shards) {
+        for (uint32_t i = 0; i <= m_shard_mask; i++) {
+            for (auto& kv : m_shards[i].map) {
+                release(kv.second);
+            }
+        }
+        delete[] m_shards;
+    }
+    if (m_inotify_fd != -1) {
+        close(m_inotify_fd);
+    }
+}
+
+void FileCache::init(const char* doc_root, bool enabled, int shards, int max_entries, int ttl_sec) {
+    // load中与realpath的结果比较，inotify也从这里开始监视，所以同样使用规范路径（去掉末尾的'/'、解析符号链接）
+    char resolved[PATH_MAX];
+    if (realpath(doc_root, resolved) != NULL) {
+        m_doc_root = resolved;
+    } else {
+        printf("doc_root %s: %s\n", doc_root, strerror(errno));
+        m_doc_root = doc_root;
+    }
+    m_enabled = enabled;
+    m_ttl_ms = ttl_sec > 0 ? ttl_sec * 1000 : 0;
+    if (!m_enabled) {
+        return;
+    }
+    // 分片数向上取整为2的幂，便于用掩码取模
+    uint32_t n = 1;
+    while ((int)n < shards) {
+        n <<= 1;
+    }
+    m_shard_mask = n - 1;
+    m_shards = new Shard[n];
+    m_shard_capacity = max_entries > (int)n ? max_entries / n : 1;
+
+    if (!start_inotify()) {
+        printf("inotify unavailable, file cache relies on TTL only\n");
+    }
+}
+
+bool FileCache::expired(const Entry* entry, int64_t now) const {
+    if (entry->generation != m_generation.load(std::memory_order_acquire)) {
+        return true;
+    }
+    return entry->expire_ms != 0 && now >= entry->expire_ms;
+}
+
+void FileCache::evict_locked(Shard& shard, std::unordered_map<std::string, Entry*>::iterator it) {
+    Entry* entry = it->second;
+    shard.map.erase(it);
+    m_evictions.fetch_add(1, std::memory_order_relaxed);
+    release(entry);
+}
+
+// 复用线程局部的key，避免每次查找都分配内存
+static thread_local std::string tl_key;
+
+bool FileCache::lookup(const char* url, Entry** out) {
+    if (!m_enabled) {
+        return false;
+    }
+    tl_key.assign(url);
+    Shard& shard = shard_of(tl_key);
+    int64_t now = m_ttl_ms > 0 ? now_ms() : 0;
+    shard.lock.lock();
+    // ------------- CRITICAL AREA --------
+    auto it = shard.map.find(tl_key);
+    if (it != shard.map.end()) {
+        Entry* entry = it->second;
+        if (!expired(entry, now)) {
+            entry->refs.fetch_add(1, std::memory_order_relaxed);
+            shard.lock.unlock();
+            metrics.add(Metrics::FILE_CACHE_HITS);
+            *out = entry;
+            return true;
+        }
+        evict_locked(shard, it);
+    }
+    // ------------- EXITING --------------
+    shard.lock.unlock();
+    return false;
+}
+
+FileCache::RESULT FileCache::acquire(const char* url, Entry** out) {
+    if (lookup(url, out)) {
+        return FILE_OK;
+    }
+    metrics.add(Metrics::FILE_CACHE_MISSES);
+
+    Entry* entry = NULL;
+    RESULT ret = load(url, &entry);
+    if (ret != FILE_OK || !m_enabled) {
+        *out = entry;
+        return ret;
+    }
+
+    // tl_key仍是lookup()中设置的url
+    Shard& shard = shard_of(tl_key);
+    shard.lock.lock();
+    // ------------- CRITICAL AREA --------
+    auto it = shard.map.find(tl_key);
+    if (it != shard.map.end()) {
+        // 其他线程同时加载了同一文件，以新加载的为准
+        Entry* old = it->second;
+        shard.map.erase(it);
+        release(old);
+    } else if (shard.map.size() >= m_shard_capacity) {
+        // 分片已满，淘汰任意一个条目
+        evict_locked(shard, shard.map.begin());
+    }
+    entry->refs.fetch_add(1, std::memory_order_relaxed);   // 缓存自身的引用
+    shard.map.emplace(tl_key, entry);
+    // ------------- EXITING --------------
+    shard.lock.unlock();
+    *out = entry;
+    return FILE_OK;
+}
+
+void FileCache::release(Entry* entry) {
+    if (entry && entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        close(entry->fd);
+        delete entry;
+    }
+}
+
+// 未命中时的加载流程，即原先do_request中的路径检查
+FileCache::RESULT FileCache::load(const char* url, Entry** out) {
+    // 先记录代数，加载期间发生的文件变化会使该条目立即失效
+    uint64_t generation = m_generation.load(std::memory_order_acquire);
+
+    std::string real_file = m_doc_root + url;
+    char resolved_path[PATH_MAX];
+    if (realpath(real_file.c_str(), resolved_path) == NULL) {
+        return FILE_NOT_FOUND;
+    }
+    // 解析规范路径并检查是否在DOC_ROOT下（DOC_ROOT为"/"时不需要检查）
+    size_t root_len = m_doc_root.size();
+    if (root_len > 1 && (strncmp(resolved_path, m_doc_root.c_str(), root_len) != 0
+        || (resolved_path[root_len] != '/' && resolved_path[root_len] != '\0'))) {
+        return FILE_FORBIDDEN;
+    }
+
+    struct stat st;
+    if (stat(resolved_path, &st) < 0) {
+        return FILE_NOT_FOUND;
+    }
+    if (access(resolved_path, R_OK) != 0) {
+        return FILE_FORBIDDEN;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return FILE_IS_DIR;
+    }
+    int fd = open(resolved_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == EACCES ? FILE_FORBIDDEN : FILE_NOT_FOUND;
+    }
+
+    Entry* entry = new Entry;
+    entry->path = resolved_path;
+    entry->st = st;
+    entry->fd = fd;
+    make_validators(entry);
+    entry->encodings = probe_encodings(resolved_path);
+    entry->generation = generation;
+    entry->expire_ms = m_ttl_ms > 0 ? now_ms() + m_ttl_ms : 0;
+    entry->refs.store(1, std::memory_order_relaxed);   // 调用者的引用
+    *out = entry;
+    return FILE_OK;
+}
+
+// inode、大小或修改时间（纳秒）任何一个改变都会得到不同的ETag，文件内容改变后FileCache会重新加载条目
+void FileCache::make_validators(Entry* entry) {
+    const struct stat& st = entry->st;
+    unsigned long long mtime_ns = (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx-%llx\"",
+             (unsigned long long)st.st_ino, (unsigned long long)st.st_size, mtime_ns);
+    struct tm tm;
+    gmtime_r(&st.st_mtime, &tm);
+    strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// 检查path旁边的预压缩文件，path本身是压缩文件时不检查
+int FileCache::probe_encodings(const char* path) {
+    static const struct {
+        const char* suffix;
+        int bit;
+    } kinds[] = { { ".gz", ENCODING_GZIP }, { ".br", ENCODING_BR } };
+    size_t len = strlen(path);
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (len > 3 && strcmp(path + len - 3, kinds[i].suffix) == 0) {
+            return 0;
+        }
+    }
+    if (len + 4 > PATH_MAX) {
+        return 0;
+    }
+    char sibling[PATH_MAX];
+    memcpy(sibling, path, len);
+    int encodings = 0;
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        memcpy(sibling + len, kinds[i].suffix, 4);
+        struct stat st;
+        if (stat(sibling, &st) == 0 && S_ISREG(st.st_mode)) {
+            encodings |= kinds[i].bit;
+        }
+    }
+    return encodings;
+}
+
+void FileCache::invalidate_all() {
+    // 只需增加代数，旧条目在下次查找时被发现失效并淘汰
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void FileCache::invalidate_path(const char* path, bool prefix) {
+    if (!m_enabled) {
+        return;
+    }
+    size_t len = strlen(path);
+    for (uint32_t i = 0; i <= m_shard_mask; i++) {
+        Shard& shard = m_shards[i];
+        shard.lock.lock();
+        // ------------- CRITICAL AREA --------
+        for (auto it = shard.map.begin(); it != shard.map.end();) {
+            const std::string& p = it->second->path;
+            bool hit = (p == path)
+                || (prefix && p.size() > len && p.compare(0, len, path) == 0 && p[len] == '/');
+            if (hit) {
+                Entry* entry = it->second;
+                it = shard.map.erase(it);
+                m_evictions.fetch_add(1, std::memory_order_relaxed);
+                release(entry);
+            } else {
+                ++it;
+            }
+        }
+        // ------------- EXITING --------------
+        shard.lock.unlock();
+    }
+}
+
+FileCache::Stats FileCache::stats() const {
+    Stats s;
+    s.hits = metrics.total(Metrics::FILE_CACHE_HITS);
+    s.misses = metrics.total(Metrics::FILE_CACHE_MISSES);
+    s.evictions = m_evictions.load(std::memory_order_relaxed);
+    return s;
+}
+
+bool FileCache::start_inotify() {
+    m_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        return false;
+    }
+    watch_tree(m_doc_root.c_str());
+    if (m_watch_dirs.empty()) {
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, inotify_worker, this) != 0) {
+        close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return false;
+    }
+    pthread_detach(tid);
+    return true;
+}
+
+// inotify不会递归监听，需要为每个子目录单独添加watch
+void FileCache::watch_tree(const char* dir) {
+    const uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE
+                        | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = inotify_add_watch(m_inotify_fd, dir, mask);
+    if (wd < 0) {
+        perror("inotify_add_watch");
+        return;
+    }
+    m_watch_dirs[wd] = dir;
+
+    DIR* d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+        if (ent->d_type == DT_DIR) {
+            std::string sub = std::string(dir) + "/" + ent->d_name;
+            watch_tree(sub.c_str());
+        }
+    }
+    closedir(d);
+}
+
+void* FileCache::inotify_worker(void* arg) {
+    FileCache* cache = static_cast<FileCache*>(arg);
+    cache->handle_events();
+    return NULL;
+}
+
+void FileCache::handle_events() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (char* p = buf; p < buf + len;) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                invalidate_all();
+                continue;
+            }
+            auto it = m_watch_dirs.find(ev->wd);
+            if (it == m_watch_dirs.end()) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                m_watch_dirs.erase(it);
+                continue;
+            }
+            std::string path = it->second;
+            if (ev->len > 0) {
+                path += "/";
+                path += ev->name;
+            }
+            if (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                // 目录结构变化可能影响realpath的解析结果（如符号链接、重命名替换），全部失效
+                invalidate_all();
+                if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    watch_tree(path.c_str());
+                }
+            } else {
+                invalidate_path(path.c_str(), (ev->mask & IN_ISDIR) != 0);
+            }
+        }
+    }
+}
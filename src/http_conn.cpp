@@ -1,12 +1,17 @@
 #include "http_conn.h"
+#include <algorithm>
 #include <cstring>
 #include <exception>
 #include <strings.h>
 #include <string>
+#include <time.h>
 #include <sys/socket.h>
 #include <sys/sendfile.h>
 
 #include "config.h"
+#include "http_scan.h"
+#include "http_format.h"
+#include "uring_reactor.h"
 
 // #define DEBUG_PRINT
 
@@ -24,21 +29,50 @@
 #endif
 
 const char* OK_200_TITLE = "OK";
+const char* PARTIAL_206_TITLE = "Partial Content";
+const char* NOT_MODIFIED_304_TITLE = "Not Modified";
 const char* ERROR_400_TITLE = "Bad Request";
 const char* ERROR_400_FORM = "Your request has bad syntax or is inherently impossible to satisfy.\n";
 const char* ERROR_403_TITLE = "Forbidden";
 const char* ERROR_403_FORM = "You do not have permission to get file from this server.\n";
 const char* ERROR_404_TITLE = "Not Found";
 const char* ERROR_404_FORM = "The requested file was not found on this server.\n";
+const char* ERROR_416_TITLE = "Range Not Satisfiable";
+const char* ERROR_416_FORM = "None of the requested ranges overlap the file.\n";
 const char* ERROR_500_TITLE = "Internal Server Error";
 const char* ERROR_500_FORM = "There was an unusual problem serving the requested file.\n";
 const char* ERROR_503_TITLE = "Service Unavailable";
 const char* ERROR_503_FORM = "The server is currently too busy to process request.\n";
 
-/* 网站的根目录 */
-const char* DOC_ROOT = "/var/www/html";
+// 保留URL：运行统计（config中的enable_stats）
+static const char STATS_URL[] = "/__stats";
+static const char STATS_PROMETHEUS_URL[] = "/__stats/prometheus";
+static const size_t STATS_BODY_MAX = 16384;
 
-extern Config cfg;
+// 预先序列化的错误响应：状态行和Date之后的部分（Content-Length、Connection、空行和页面内容）
+// 按Connection方式各一份，启动时生成一次，之后只读；发送时直接作为响应体引用，不复制
+struct StaticResponse {
+    int status;
+    const char* title;
+    std::string tail[2];    // 下标为linger
+};
+
+static StaticResponse make_static_response(int status, const char* title, const char* form) {
+    StaticResponse r;
+    r.status = status;
+    r.title = title;
+    for (int linger = 0; linger < 2; linger++) {
+        r.tail[linger] = "Content-Length: " + std::to_string(strlen(form)) + "\r\n"
+                       + "Connection: " + (linger ? "keep-alive" : "close") + "\r\n\r\n" + form;
+    }
+    return r;
+}
+
+static const StaticResponse s_error_400 = make_static_response(400, ERROR_400_TITLE, ERROR_400_FORM);
+static const StaticResponse s_error_403 = make_static_response(403, ERROR_403_TITLE, ERROR_403_FORM);
+static const StaticResponse s_error_404 = make_static_response(404, ERROR_404_TITLE, ERROR_404_FORM);
+static const StaticResponse s_error_500 = make_static_response(500, ERROR_500_TITLE, ERROR_500_FORM);
+static const StaticResponse s_error_503 = make_static_response(503, ERROR_503_TITLE, ERROR_503_FORM);
 
 std::string get_method_name(HTTPConn::METHOD method) {
     switch (method) {
@@ -75,6 +109,7 @@ int setnonblocking(int fd) {
     return old_option;
 }
 
+// fd必须已经是非阻塞的（accept4/socket/socketpair时指定SOCK_NONBLOCK）
 // oneshot: 是否启用EPOLLONESHOT选项
 // trig_mode: 选择LT工作模式(0)/ET工作模式(1)
 void addfd(int epollfd, int fd, bool oneshot, int trig_mode = 1) {
@@ -89,34 +124,51 @@ void addfd(int epollfd, int fd, bool oneshot, int trig_mode = 1) {
     if (oneshot) {
         e.events |= EPOLLONESHOT;
     }
-    setnonblocking(fd);
+    metrics.add(Metrics::EPOLL_CTL);
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &e);
 }
 
 void removefd(int epollfd, int fd) {
+    metrics.add(Metrics::EPOLL_CTL);
     assert(epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, 0) == 0);
     close(fd);
 }
 
-void modfd(int epollfd, int fd, int ev) {
-    epoll_event event;
-    event.data.fd = fd;
-    event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;
-    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
-}
-
-int HTTPConn::m_user_count = 0;
+std::atomic_int HTTPConn::m_user_count(0);
+std::atomic<uint64_t> HTTPConn::m_timeouts[HTTPConn::TIMEOUT_KINDS];
 // int HTTPConn::m_epollfd = -1;
 
 void HTTPConn::close_conn(bool real_close) {
     if (real_close && (m_sockfd != -1)) {
+        if (m_uring && !m_uring->detach(m_sockfd)) {
+            // 内核中还有引用连接缓冲区的操作，全部取消后reactor会再次调用close_conn
+            return;
+        }
         int closing_fd = m_sockfd;
         DPRINT("[%d.%d]Socket closed", m_epollfd, m_sockfd);
         m_sockfd = -1;
+        // 就绪列表中的条目随之失效（见take_ready）
+        m_ready_queued = false;
 
         unmap();
+        release_responses();
+        release_buffers();
+        m_timers->cancel(&m_timer);
 
         m_user_count--;
+        if (m_reactor_users) {
+            m_reactor_users->fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (m_uring) {
+            m_uring->close_fd(closing_fd);
+            return;
+        }
+        if (m_ep_state == EP_NONE) {
+            // 交给线程池前注销的连接（队列已满时直接关闭）
+            close(closing_fd);
+            return;
+        }
+        m_ep_state = EP_NONE;
         removefd(m_epollfd, closing_fd);    // removefd会close(fd)，这时候会有新的连接被分配到这个fd上，所以m_sockfd = -1不能后执行
     }
 }
@@ -127,53 +179,220 @@ void HTTPConn::close_conn_write() {
     }
 }
 
-void HTTPConn::init(int sockfd, int epollfd, const sockaddr_in& addr) {
+// 处理过程中出错：reactor线程中直接关闭连接；工作线程中只释放资源并关闭写端，
+// 由reactor在RDHUP或超时时关闭，保证连接只在reactor线程中被释放
+void HTTPConn::abort_conn() {
+    if (m_run_inline) {
+        close_conn();
+        return;
+    }
+    unmap();
+    release_responses();
+    set_timeout(TIMEOUT_WRITE);
+    close_conn_write();
+    rearm(EPOLLIN);
+}
+
+// 等待下一个事件：epoll方式下只在注册需要改变时调用epoll_ctl，io_uring方式下通知reactor
+// reactor线程中并且启用run_to_completion时（请求通常在reactor内处理完毕）使用常驻注册，之后的rearm都不需要系统调用；
+// 工作线程中（以及关闭run_to_completion时）使用EPOLLONESHOT，保证工作线程处理期间reactor不会收到该连接的事件
+void HTTPConn::rearm(int ev) {
+    if (m_in_worker.load(std::memory_order_relaxed) > 0) {
+        rearm_from_worker(ev);
+        return;
+    }
+    if (m_uring) {
+        m_uring->rearm(m_sockfd, ev);
+        return;
+    }
+    if (live_cfg().run_to_completion) {
+        if (m_ep_state == EP_PERSISTENT) {
+            metrics.add(Metrics::EPOLL_CTL_SKIPPED);
+            return;
+        }
+        // 边沿触发的ADD/MOD会重新检查就绪状态，套接字可写时立即产生一次EPOLLOUT，所以ev为EPOLLOUT时也不会错过
+        update_events(EP_PERSISTENT, EPOLLIN | EPOLLOUT);
+        return;
+    }
+    if (m_ep_state == EP_ONESHOT_ARMED && m_ep_events == ev) {
+        metrics.add(Metrics::EPOLL_CTL_SKIPPED);
+        return;
+    }
+    update_events(EP_ONESHOT_ARMED, ev);
+}
+
+// 工作线程的最后一步：重新注册之后reactor随时可能关闭连接，并在同一个对象上构造新的连接，所以计数要在注册之前减一；
+// 两步都在时间轮的锁内完成，timer_check要么看到计数不为0，要么看到注册已经完成，不会在注册之前因超时关闭连接
+void HTTPConn::rearm_from_worker(int ev) {
+    TimerWheel* timers = m_timers;
+    timers->lock();
+    // ------------- CRITICAL AREA --------
+    leave_worker();
+    if (m_uring) {
+        m_uring->rearm(m_sockfd, ev);
+    } else {
+        update_events(EP_ONESHOT_ARMED, ev);
+    }
+    // 从这里开始不能再访问连接
+    // ------------- EXITING --------------
+    timers->unlock();
+}
+
+// 状态要在epoll_ctl之前更新：在工作线程中调用时，epoll_ctl返回前reactor就可能收到事件并调用on_event
+void HTTPConn::update_events(EP_STATE state, int ev) {
+    int op = state == EP_NONE ? EPOLL_CTL_DEL : (m_ep_state == EP_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD);
+    epoll_event event;
+    event.data.fd = m_sockfd;
+    event.events = ev | EPOLLET | EPOLLRDHUP;
+    if (state == EP_ONESHOT_ARMED) {
+        event.events |= EPOLLONESHOT;
+    }
+    m_ep_state = state;
+    m_ep_events = ev;
+    metrics.add(Metrics::EPOLL_CTL);
+    epoll_ctl(m_epollfd, op, event.data.fd, &event);
+}
+
+// 设置kind类型的超时，超时时间为0时取消定时器
+// 可能在工作线程中调用，到期时间和类型先写入原子变量，时间轮的锁保证reactor检查时能看到
+void HTTPConn::set_timeout(TIMEOUT_KIND kind) {
+    int sec = 0;
+    switch (kind) {
+        case TIMEOUT_HEADER:
+            sec = live_cfg().header_timeout;
+            break;
+        case TIMEOUT_IDLE:
+            sec = live_cfg().keepalive_timeout;
+            break;
+        case TIMEOUT_WRITE:
+            sec = live_cfg().write_timeout;
+            break;
+        default:
+            break;
+    }
+    m_timeout_kind.store(kind, std::memory_order_relaxed);
+    if (sec <= 0) {
+        m_deadline_ms.store(0, std::memory_order_relaxed);
+        m_timers->cancel(&m_timer);
+        return;
+    }
+    int64_t deadline = TimerWheel::now_ms() + (int64_t)sec * 1000;
+    m_deadline_ms.store(deadline, std::memory_order_relaxed);
+    m_timers->arm(&m_timer, deadline);
+}
+
+// 在持有时间轮锁时调用
+bool HTTPConn::timer_check(TimerWheel::Node* node, int64_t now, int64_t* next) {
+    HTTPConn* conn = (HTTPConn*)node->owner;
+    if (conn->m_in_worker.load(std::memory_order_acquire) > 0) {
+        // 正在线程池中处理，推迟到下一个tick再检查
+        *next = now + TimerWheel::TICK_MS;
+        return false;
+    }
+    int64_t deadline = conn->m_deadline_ms.load(std::memory_order_relaxed);
+    if (deadline == 0) {
+        return false;
+    }
+    if (deadline > now) {
+        *next = deadline;
+        return false;
+    }
+    return true;
+}
+
+void HTTPConn::expire_timeout() {
+    int kind = m_timeout_kind.load(std::memory_order_relaxed);
+    m_timeouts[kind].fetch_add(1, std::memory_order_relaxed);
+    DPRINT("[%d.%d]Timeout, kind = %d", m_epollfd, m_sockfd, kind);
+    close_conn();
+}
+
+void HTTPConn::init(int sockfd, int epollfd, const sockaddr_in& addr, BufferPool* pool, TimerWheel* timers,
+                    UringReactor* uring, std::atomic_int* reactor_users, ReadyList* ready) {
     m_sockfd = sockfd;
     m_address = addr;
     m_epollfd = epollfd;
+    m_pool = pool;
+    m_timers = timers;
+    m_uring = uring;
+    m_timer.owner = this;
+    m_reactor_users = reactor_users;
+    m_ready = ready;
+    m_ready_queued = false;
     m_user_count++;
-    
+    if (m_reactor_users) {
+        m_reactor_users->fetch_add(1, std::memory_order_relaxed);
+    }
+
     init();
+    // 第一个请求必须在header_timeout内到达
+    set_timeout(TIMEOUT_HEADER);
     DPRINT("sockfd = %d, epollfd = %d", sockfd, m_epollfd);
-    addfd(m_epollfd, sockfd, true); 
-    // 放在init后面，因为addfd后sub reactor（其他线程）就会开始事件监听，如果addfd放前面，
-    // 就有可能出现sub reactor线程开始处理而HTTPConn对象还没有初始化完成的情况，在单Reactor
-    // 模式下不出问题的原因是init()调用者和m_epollfd的监听者是同一线程
-
+    if (m_uring) {
+        // 由reactor提交recv
+        return;
+    }
+    // 调用者就是m_epollfd的监听者，对象初始化完成之前不会处理它的事件
+    m_ep_state = EP_NONE;
+    rearm(EPOLLIN);
 }
 
 void HTTPConn::init() {
     DPRINT("initialized");
+    reset_request();
+    m_start_line = 0;
+    m_cur_pos = 0;
+    m_end_pos = 0;
+    m_req_start = 0;
+    m_write_idx = 0;
+    m_filefd = -1;
+    m_file_address = 0;
+    m_file_entry = NULL;
+    m_content_entry = NULL;
+    release_ranges();
+    m_run_inline = false;
+    m_deferred = false;
+    m_file_size = 0;
+    m_resp_head = 0;
+    m_resp_count = 0;
+    m_last_linger = false;
+    m_batch_ns = 0;
+    // 连接进入空闲状态，缓冲区归还内存池
+    release_responses();
+    release_buffers();
+}
+
+void HTTPConn::reset_request() {
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
-
     m_method = GET;
     m_url = 0;
     m_version = 0;
     m_content_length = 0;
     m_host = 0;
-    m_start_line = 0;
-    m_cur_pos = 0;
-    m_end_pos = 0;
-    m_write_idx = 0;
-    m_bytes_to_send = 0;
-    m_bytes_sent = 0;
-    m_filefd = -1;
-    m_file_address = 0;
-    memset(m_read_buf, 0, READ_BUFFER_SIZE);
-    memset(m_write_buf, 0, WRITE_BUFFER_SIZE);
-    memset(m_real_file, 0, FILENAME_LEN);
+    m_range = 0;
+    m_if_range = 0;
+    m_if_none_match = 0;
+    m_if_modified_since = 0;
+    m_accept_encoding = 0;
+    m_content_encoding = NULL;
+    m_vary = false;
 }
 
 bool HTTPConn::read() {
-        if (m_end_pos >= READ_BUFFER_SIZE) {
+        if (!ensure_read_buf()) {
             return false;
         }
         [[maybe_unused]]int bytes_read_total = 0;
         int bytes_read = 0;
     
         while (true) {
-            bytes_read = recv(m_sockfd, m_read_buf + m_end_pos, READ_BUFFER_SIZE - m_end_pos, 0);
+            if (m_end_pos >= m_read_size && !grow_read_buf()) {
+                // 请求超过max_request_size
+                DPRINT("[%d.%d]Request too large", m_epollfd, m_sockfd);
+                return false;
+            }
+            bytes_read = recv(m_sockfd, m_read_buf + m_end_pos, m_read_size - m_end_pos, 0);
             bytes_read_total += bytes_read == -1 ? 0 : bytes_read;
             DPRINT("[%d.%d]Recv %d bytes", m_epollfd, m_sockfd, bytes_read);
             if (bytes_read == -1) {
@@ -191,15 +410,228 @@ bool HTTPConn::read() {
             m_end_pos += bytes_read;
         }
         DPRINT("[%d.%d]Read %d bytes, addr=%lu", m_epollfd, m_sockfd, bytes_read_total, (ulong)m_read_buf);
+        if (m_batch_ns == 0 && m_end_pos > 0) {
+            m_batch_ns = Metrics::now_ns();
+        }
         return true;
     
 }
 
+// 配置的缓冲区大小按内存池的大小等级取整
+static int pool_block_size(int configured) {
+    size_t size = BufferPool::min_size();
+    while (size < (size_t)configured && size < BufferPool::max_size()) {
+        size <<= 1;
+    }
+    return (int)size;
+}
+
+// 新请求到来时才从内存池借用读缓冲区
+bool HTTPConn::ensure_read_buf() {
+    if (!m_read_buf) {
+        int size = pool_block_size(live_cfg().read_buffer_size);
+        m_read_buf = m_pool->alloc(size);
+        m_read_size = m_read_buf ? size : 0;
+    }
+    return m_read_buf != NULL;
+}
+
+// io_uring：内核已把数据收到reactor的接收缓冲区中，复制到读缓冲区末尾（对应read()）
+bool HTTPConn::append_input(const char* data, size_t len) {
+    if (!ensure_read_buf()) {
+        return false;
+    }
+    while (len > 0) {
+        if (m_end_pos >= m_read_size && !grow_read_buf()) {
+            DPRINT("[%d.%d]Request too large", m_epollfd, m_sockfd);
+            return false;
+        }
+        size_t n = std::min(len, (size_t)(m_read_size - m_end_pos));
+        memcpy(m_read_buf + m_end_pos, data, n);
+        m_end_pos += n;
+        data += n;
+        len -= n;
+    }
+    if (m_batch_ns == 0 && m_end_pos > 0) {
+        m_batch_ns = Metrics::now_ns();
+    }
+    return true;
+}
+
+// 读缓冲区已满而请求仍不完整时，换用大一级的块并复制已读入的数据
+// 解析器直接在缓冲区上原地切分字符串，要求数据连续，因此不把多个块串成链表，
+// 而是迁移到更大的块，同时修正已经指向旧缓冲区的指针
+bool HTTPConn::grow_read_buf() {
+    int new_size = m_read_size * 2;
+    if (new_size > live_cfg().max_request_size || (size_t)new_size > BufferPool::max_size()) {
+        return false;
+    }
+    char* new_buf = m_pool->alloc(new_size);
+    if (!new_buf) {
+        return false;
+    }
+    memcpy(new_buf, m_read_buf, m_end_pos);
+    rebase_read_ptrs(m_read_buf, new_buf);
+    m_pool->free(m_read_buf, m_read_size);
+    m_read_buf = new_buf;
+    m_read_size = new_size;
+    return true;
+}
+
+// 修正指向读缓冲区中当前请求的指针，old_base处的数据已被移动到new_base处
+void HTTPConn::rebase_read_ptrs(const char* old_base, char* new_base) {
+    char** ptrs[] = { &m_url, &m_version, &m_host, &m_range, &m_if_range,
+                      &m_if_none_match, &m_if_modified_since };
+    for (size_t i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) {
+        if (*ptrs[i]) {
+            *ptrs[i] = new_base + (*ptrs[i] - old_base);
+        }
+    }
+}
+
+// 管线化：已处理完的请求不再被引用，把剩余数据（下一个请求的开头，可能是完整的请求）移到缓冲区开头，
+// 而不是像以前那样在发送完响应后整个丢弃；缓冲区为空时归还内存池
+void HTTPConn::compact_read_buf() {
+    if (!m_read_buf) {
+        return;
+    }
+    if (m_req_start > 0) {
+        int remain = m_end_pos - m_req_start;
+        memmove(m_read_buf, m_read_buf + m_req_start, remain);
+        rebase_read_ptrs(m_read_buf + m_req_start, m_read_buf);
+        m_start_line -= m_req_start;
+        m_cur_pos -= m_req_start;
+        m_end_pos = remain;
+        m_req_start = 0;
+    }
+    if (m_end_pos == 0) {
+        m_pool->free(m_read_buf, m_read_size);
+        m_read_buf = NULL;
+        m_read_size = 0;
+        m_start_line = 0;
+        m_cur_pos = 0;
+    }
+}
+
+bool HTTPConn::ensure_write_buf() {
+    if (!m_write_buf) {
+        int size = pool_block_size(live_cfg().write_buffer_size);
+        m_write_buf = m_pool->alloc(size);
+        m_write_size = m_write_buf ? size : 0;
+    }
+    return m_write_buf != NULL;
+}
+
+// 同一批管线化请求的响应头都放在写缓冲区中，空间不够时换用更大的块
+// 响应只记录头部在缓冲区中的偏移，迁移后不需要修正
+bool HTTPConn::grow_write_buf() {
+    int new_size = m_write_size * 2;
+    if ((size_t)new_size > BufferPool::max_size()) {
+        return false;
+    }
+    char* new_buf = m_pool->alloc(new_size);
+    if (!new_buf) {
+        return false;
+    }
+    memcpy(new_buf, m_write_buf, m_write_idx);
+    m_pool->free(m_write_buf, m_write_size);
+    m_write_buf = new_buf;
+    m_write_size = new_size;
+    return true;
+}
+
+bool HTTPConn::ensure_responses() {
+    if (!m_resp) {
+        int depth = std::min(std::max(live_cfg().pipeline_depth, 1), (int)MAX_PIPELINE_DEPTH);
+        // 多区间的206响应在队列中占用多项（见add_range_responses），额外预留MAX_RANGES项，
+        // 保证队列中少于depth项时任何一个请求的响应都放得下
+        int cap = depth + MAX_RANGES;
+        size_t size = BufferPool::min_size();
+        while (size < cap * sizeof(Response)) {
+            size <<= 1;
+        }
+        m_resp = (Response*)m_pool->alloc(size);
+        if (!m_resp) {
+            return false;
+        }
+        // 归还时按m_resp_cap * sizeof(Response)计算大小等级，结果与size相同
+        m_resp_cap = cap;
+        m_resp_limit = depth;
+        m_resp_head = 0;
+        m_resp_count = 0;
+    }
+    return true;
+}
+
+void HTTPConn::finish_response(Response& r) {
+    if (r.mmap_addr) {
+        munmap(r.mmap_addr, r.mmap_len);
+        r.mmap_addr = NULL;
+    }
+    if (r.content_entry) {
+        ContentCache::release(r.content_entry);
+        r.content_entry = NULL;
+    }
+    if (r.file_entry) {
+        FileCache::release(r.file_entry);
+        r.file_entry = NULL;
+    }
+}
+
+// 释放所有未发送完的响应，连同响应队列和写缓冲区归还内存池
+void HTTPConn::release_responses() {
+    if (m_resp) {
+        for (int i = m_resp_head; i < m_resp_count; i++) {
+            finish_response(m_resp[i]);
+        }
+        m_pool->free((char*)m_resp, m_resp_cap * sizeof(Response));
+        m_resp = NULL;
+        m_resp_cap = 0;
+        m_resp_limit = 0;
+    }
+    m_resp_head = 0;
+    m_resp_count = 0;
+    m_write_idx = 0;
+    if (m_write_buf) {
+        m_pool->free(m_write_buf, m_write_size);
+        m_write_buf = NULL;
+        m_write_size = 0;
+    }
+}
+
+void HTTPConn::release_buffers() {
+    if (m_read_buf) {
+        m_pool->free(m_read_buf, m_read_size);
+        m_read_buf = NULL;
+        m_read_size = 0;
+    }
+    if (m_write_buf) {
+        m_pool->free(m_write_buf, m_write_size);
+        m_write_buf = NULL;
+        m_write_size = 0;
+    }
+}
+
+HTTPConn* HTTPConn::create_table(int n) {
+    // 只保留地址空间，页在对应fd第一次被使用时才分配
+    void* table = mmap(NULL, sizeof(HTTPConn) * n, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return table == MAP_FAILED ? NULL : (HTTPConn*)table;
+}
+
+void HTTPConn::destroy_table(HTTPConn* table, int n) {
+    munmap(table, sizeof(HTTPConn) * n);
+}
 
 HTTPConn::LINE_STATUS HTTPConn::parse_line() {
     char temp;
     // m_cur_pos指向buffer中当前正在分析的字节，m_end_pos为buffer中尾部的下一字节
     while (m_cur_pos < m_end_pos) {
+        // 用SIMD跳过不含\r、\n的字节
+        m_cur_pos = scan_eol(m_read_buf + m_cur_pos, m_read_buf + m_end_pos) - m_read_buf;
+        if (m_cur_pos == m_end_pos) {
+            break;
+        }
         temp = m_read_buf[m_cur_pos];
         if (temp == '\r') {
             if (m_cur_pos + 1 == m_end_pos) {
@@ -230,10 +662,11 @@ HTTPConn::LINE_STATUS HTTPConn::parse_line() {
     return LINE_OPEN;
 }
 
-HTTPConn::HTTP_CODE HTTPConn::parse_requestline(char* text) {
-    // strpbrk在temp中寻找pattern中任一字符首次出现的位置
-    m_url = strpbrk(text, " \t");
-    if (!m_url) {
+// end为请求行末尾（原先\r的位置）
+HTTPConn::HTTP_CODE HTTPConn::parse_requestline(char* text, char* end) {
+    // 寻找第一个空白字符
+    m_url = (char*)scan_space(text, end);
+    if (m_url == end) {
         // 要求请求行中必须有空白字符或'\t'字符
         return BAD_REQUEST;
     }
@@ -253,8 +686,8 @@ HTTPConn::HTTP_CODE HTTPConn::parse_requestline(char* text) {
 
     m_url += strspn(m_url, " \t");
     // 版本号检查
-    m_version = strpbrk(m_url, " \t");
-    if (!m_version) {
+    m_version = (char*)scan_space(m_url, end);
+    if (m_version == end) {
         return BAD_REQUEST;
     }
     *m_version++ = '\0';
@@ -269,6 +702,8 @@ HTTPConn::HTTP_CODE HTTPConn::parse_requestline(char* text) {
         m_http_ver = HTTP_UNSUPPORTED;
         return BAD_REQUEST;
     }
+    // HTTP/1.1默认为持久连接（管线化的前提），可被Connection字段覆盖
+    m_linger = (m_http_ver == HTTP1_1);
 
     // 检查URL是否合法
     if (strncasecmp(m_url, "http://", 7) == 0) {
@@ -296,35 +731,167 @@ HTTPConn::HTTP_CODE HTTPConn::parse_headers(char* text) {
             return NO_REQUEST;
         }
         return GET_REQUEST;
-    } else if (strncasecmp(text, "Host:", 5) == 0) {
-        text += 5; 
-        text += strspn(text, " \t");
-        m_host = text;
-    } else if (strncasecmp(text, "Connection:", 11) == 0) {
-        // 连接方式
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
-        } else if (strcasecmp(text, "close") == 0) {
-            m_linger = false;
+    }
+    char* colon = strchr(text, ':');
+    if (!colon) {
+        // Unknown header
+        return NO_REQUEST;
+    }
+    char* value = colon + 1;
+    value += strspn(value, " \t");
+    return parse_header(text, colon - text, value);
+}
+
+// Accept-Encoding：客户端接受的预压缩格式，q=0表示拒绝该格式（显式拒绝优先于*）
+static int parse_accept_encoding(const char* value) {
+    int accepted = 0;
+    int refused = 0;
+    const char* p = value;
+    while (true) {
+        p += strspn(p, " \t,");
+        if (*p == '\0') {
+            break;
+        }
+        size_t n = strcspn(p, " \t,;");
+        const char* name = p;
+        const char* end = p + strcspn(p, ",");
+        bool zero = false;
+        for (const char* s = p + n; s + 1 < end; s++) {
+            if ((s[0] == 'q' || s[0] == 'Q') && s[1] == '=') {
+                zero = atof(s + 2) <= 0;
+                break;
+            }
+        }
+        int bits = 0;
+        if ((n == 4 && strncasecmp(name, "gzip", 4) == 0) || (n == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            bits = FileCache::ENCODING_GZIP;
+        } else if (n == 2 && strncasecmp(name, "br", 2) == 0) {
+            bits = FileCache::ENCODING_BR;
+        } else if (n == 1 && name[0] == '*') {
+            bits = zero ? 0 : FileCache::ENCODING_GZIP | FileCache::ENCODING_BR;
+            zero = false;
+        }
+        if (zero) {
+            refused |= bits;
         } else {
-            return BAD_REQUEST; // unknown connection method
+            accepted |= bits;
         }
-    } else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    } else {
-        // Unknown header
+        p = end;
+    }
+    return accepted & ~refused;
+}
+
+// 处理一个头部字段，value已跳过前导空白并以'\0'结尾
+// 先按名字长度分派，每个头部最多只需要一次strncasecmp
+HTTPConn::HTTP_CODE HTTPConn::parse_header(const char* name, int name_len, char* value) {
+    switch (name_len) {
+        case 4:
+            if (strncasecmp(name, "Host", 4) == 0) {
+                m_host = value;
+            }
+            break;
+        case 5:
+            if (strncasecmp(name, "Range", 5) == 0) {
+                // 文件大小确定后才能解析，见do_request
+                m_range = value;
+            }
+            break;
+        case 8:
+            if (strncasecmp(name, "If-Range", 8) == 0) {
+                m_if_range = value;
+            }
+            break;
+        case 10:
+            if (strncasecmp(name, "Connection", 10) == 0) {
+                // 连接方式
+                if (strcasecmp(value, "keep-alive") == 0) {
+                    m_linger = true;
+                } else if (strcasecmp(value, "close") == 0) {
+                    m_linger = false;
+                } else {
+                    return BAD_REQUEST; // unknown connection method
+                }
+            }
+            break;
+        case 13:
+            if (strncasecmp(name, "If-None-Match", 13) == 0) {
+                m_if_none_match = value;
+            }
+            break;
+        case 14:
+            if (strncasecmp(name, "Content-Length", 14) == 0) {
+                // 只接受十进制数字并且不超过max_request_size：负数会让m_cur_pos退回当前请求中，过大的值会溢出
+                char* end;
+                errno = 0;
+                long len = strtol(value, &end, 10);
+                end += strspn(end, " \t");
+                if (*value < '0' || *value > '9' || *end != '\0' || errno == ERANGE ||
+                    len > live_cfg().max_request_size) {
+                    return BAD_REQUEST;
+                }
+                m_content_length = (int)len;
+            }
+            break;
+        case 15:
+            if (strncasecmp(name, "Accept-Encoding", 15) == 0) {
+                m_accept_encoding = parse_accept_encoding(value);
+            }
+            break;
+        case 17:
+            if (strncasecmp(name, "If-Modified-Since", 17) == 0) {
+                m_if_modified_since = value;
+            }
+            break;
+        default:
+            // Unknown header
+            break;
     }
     return NO_REQUEST;
 }
 
-HTTPConn::HTTP_CODE HTTPConn::parse_content(char* text) {
+// 头部已经完整到达时（常见情况），一次扫描得到所有头部行的位置，省去逐行调用parse_line
+// 返回false表示头部不完整（或格式有问题），此时没有消耗任何数据，由逐行解析继续处理
+bool HTTPConn::parse_header_block(HTTP_CODE* ret) {
+    HeaderSpan spans[MAX_HEADER_LINES];
+    size_t consumed = 0;
+    char* base = m_read_buf + m_cur_pos;
+    int n = scan_headers(base, m_end_pos - m_cur_pos, spans, MAX_HEADER_LINES, &consumed);
+    if (n < 0) {
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        const HeaderSpan& span = spans[i];
+        // 与parse_line一样把行尾的\r\n改为'\0'
+        char* line_end = base + (span.value_off >= 0 ? span.value_off + span.value_len
+                                                     : span.name_off + span.name_len);
+        line_end[0] = '\0';
+        line_end[1] = '\0';
+        if (span.value_off < 0) {
+            // Unknown header
+            continue;
+        }
+        *ret = parse_header(base + span.name_off, span.name_len, base + span.value_off);
+        if (*ret == BAD_REQUEST) {
+            return true;
+        }
+    }
+    // 空行
+    char* blank = base + consumed - 2;
+    blank[0] = '\0';
+    blank[1] = '\0';
+    m_cur_pos += consumed;
+    m_start_line = m_cur_pos;
+    *ret = parse_headers(blank);
+    return true;
+}
+
+HTTPConn::HTTP_CODE HTTPConn::parse_content([[maybe_unused]]char* text) {
     // 判断消息是否被完整读入了
     if (m_end_pos >= (m_content_length + m_cur_pos)) {
-        text[m_content_length] = '\0';
+        // 跳过消息体，下一个管线化请求紧跟在它后面
+        // （不能再在消息体末尾写'\0'，那个位置是下一个请求的第一个字节）
+        m_cur_pos += m_content_length;
+        m_start_line = m_cur_pos;
         return GET_REQUEST;
     }
     return NO_REQUEST;
@@ -343,10 +910,19 @@ HTTPConn::HTTP_CODE HTTPConn::process_read() {
         // 根据当前主状态机状态进行操作
         switch (m_check_state) {
             case CHECK_STATE_REQUESTLINE:   // 请求行
-                retcode = parse_requestline(text);
+                retcode = parse_requestline(text, m_read_buf + m_cur_pos - 2);
                 if (retcode == BAD_REQUEST) {
                     return BAD_REQUEST;
                 }
+                // 头部通常与请求行一起到达，尝试一次扫描解析全部头部
+                if (parse_header_block(&retcode)) {
+                    if (retcode == BAD_REQUEST) {
+                        return BAD_REQUEST;
+                    } else if (retcode == GET_REQUEST) {
+                        return do_request();
+                    }
+                    // 有消息体，状态机已转移至CHECK_STATE_CONTENT
+                }
                 break;
             case CHECK_STATE_HEADER:    // 头部
                 retcode = parse_headers(text);
@@ -361,8 +937,8 @@ HTTPConn::HTTP_CODE HTTPConn::process_read() {
                 if (retcode == GET_REQUEST) {
                     return do_request();
                 }
-                linestatus = LINE_OPEN;
-                break;
+                // 消息体尚未完整到达；不能继续调用parse_line，否则m_cur_pos会越过消息体
+                return NO_REQUEST;
             default:    // 状态机进入非法状态
                 return INTERNAL_ERROR;
         }
@@ -371,240 +947,719 @@ HTTPConn::HTTP_CODE HTTPConn::process_read() {
 }
 
 // 得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性
-// 目标文件存在且不是目录，则使用mmap将其映射到内存地址m_file_address处，并告诉调用者获取文件成功
+// 目标文件的路径解析、stat和open由FileCache完成，热点文件命中缓存时不产生路径相关的系统调用
+// 目标文件存在且不是目录，则使用mmap将其映射到内存地址m_file_address处（或记录fd用于sendfile），并告诉调用者获取文件成功
 HTTPConn::HTTP_CODE HTTPConn::do_request() {
-    // 初始化路径
-    strncpy(m_real_file, DOC_ROOT, FILENAME_LEN);
-    m_real_file[FILENAME_LEN - 1] = '\0'; // 确保终止
-    int base_len = strlen(DOC_ROOT);
-
-    // 处理根路径或拼接URL
+    if (live_cfg().enable_stats && (strcmp(m_url, STATS_URL) == 0 || strcmp(m_url, STATS_PROMETHEUS_URL) == 0)) {
+        return STATS_REQUEST;
+    }
+    // 规范化URL：根路径映射到index.html
+    const char* url = m_url;
     if (strcmp(m_url, "/") == 0) {
-        if (base_len + 11 >= FILENAME_LEN) { // "/index.html" + \0
-            return BAD_REQUEST;
-        }
-        strncat(m_real_file, "/index.html", FILENAME_LEN - base_len - 1);
-    } else {
+        url = "/index.html";
+    } else if (strstr(m_url, "..")) {
         // 检查URL合法性（防止路径遍历）
-        if (strstr(m_url, "..")) {
-            return FORBIDDEN_REQUEST;
-        }
-        if (base_len + strlen(m_url) + 1 > FILENAME_LEN) {
-            return BAD_REQUEST;
-        }
-        strncat(m_real_file, m_url, FILENAME_LEN - base_len - 1);
+        return FORBIDDEN_REQUEST;
+    }
+    if (strlen(cfg.doc_root) + strlen(url) + 1 > FILENAME_LEN) {
+        return BAD_REQUEST;
     }
 
-    // 解析规范路径并检查是否在DOC_ROOT下
-    char resolved_path[FILENAME_LEN];
-    if (realpath(m_real_file, resolved_path) == NULL) {
-        return NO_RESOURCE;
+    FileCache::Entry* entry = NULL;
+    if (m_run_inline && !file_cache.lookup(url, &entry)) {
+        // reactor线程内不做路径解析等可能阻塞的操作，交给线程池
+        return DEFERRED_REQUEST;
     }
-    if (strncmp(resolved_path, DOC_ROOT, strlen(DOC_ROOT)) != 0) {
-        return FORBIDDEN_REQUEST;
+    switch (entry ? FileCache::FILE_OK : file_cache.acquire(url, &entry)) {
+        case FileCache::FILE_OK:
+            break;
+        case FileCache::FILE_NOT_FOUND:
+            return NO_RESOURCE;
+        case FileCache::FILE_FORBIDDEN:
+            return FORBIDDEN_REQUEST;
+        case FileCache::FILE_IS_DIR:
+        default:
+            return BAD_REQUEST;
     }
-    strcpy(m_real_file, resolved_path);
-    
-    if (stat(m_real_file, &m_file_stat) < 0) {
-        return NO_RESOURCE;
+    // 预压缩：改为发送旁边的压缩文件，之后的条件请求、Range都针对这个表示
+    m_vary = entry->encodings != 0;
+    m_content_encoding = NULL;
+    if ((entry->encodings & m_accept_encoding) && !select_encoding(url, &entry, entry->encodings & m_accept_encoding)) {
+        FileCache::release(entry);
+        return DEFERRED_REQUEST;
     }
-    if (access(m_real_file, R_OK) != 0) {
-        return FORBIDDEN_REQUEST;
+    m_file_entry = entry;
+    m_file_size = entry->st.st_size;
+
+    // 条件请求：客户端的副本仍然有效，只返回304，不读取、映射文件
+    if (not_modified(entry)) {
+        return NOT_MODIFIED;
     }
-    if (S_ISDIR(m_file_stat.st_mode)) {
-        return BAD_REQUEST;
+
+    // Range：If-Range不匹配（文件已改变）或者Range无法解析时忽略，返回整个文件
+    m_range_count = 0;
+    if (m_range && if_range_matches(entry)) {
+        int count = parse_ranges(m_file_size);
+        if (count <= 0) {
+            release_ranges();
+            if (count < 0) {
+                return RANGE_NOT_SATISFIABLE;
+            }
+        }
+        m_range_count = std::max(count, 0);
+    }
+
+    // 小文件：直接使用缓存的完整响应，不再mmap/sendfile（部分内容的响应不经过缓存）
+    if (m_range_count == 0 && content_cache.cacheable(m_file_size)) {
+        m_content_entry = content_cache.acquire(entry, m_linger, m_content_encoding != NULL, m_vary);
+        if (!m_content_entry && m_run_inline) {
+            // 生成缓存需要读取文件内容，交给线程池
+            unmap();
+            return DEFERRED_REQUEST;
+        }
+        if (!m_content_entry) {
+            // 未命中，按process_write的格式生成响应头，连同文件内容一起放入缓存
+            // 写缓冲区中可能已有同一批管线化请求的响应头，从当前位置开始临时写入
+            // 状态行和Date不放入缓存，每次发送时生成
+            int start = m_write_idx;
+            if (add_validators() && add_encoding() && add_accept_ranges() && add_headers(m_file_size)) {
+                m_content_entry = content_cache.insert(entry, m_linger, m_content_encoding != NULL, m_vary,
+                                                       m_write_buf + start, m_write_idx - start);
+            }
+            m_write_idx = start;
+        }
+        if (m_content_entry) {
+            return FILE_REQUEST;
+        }
     }
-    int fd = open(m_real_file, O_RDONLY);
-    // sendfile优化
-    if (cfg.use_sendfile) {
-        // sendfile
-        m_filefd = fd;
+
+    // sendfile优化（io_uring没有对应的操作，响应体使用mmap与响应头一起sendmsg）
+    if (live_cfg().use_sendfile && !m_uring) {
+        // sendfile，fd由缓存共享，发送偏移由响应自己维护（Range请求从区间起始处开始）
+        m_filefd = entry->fd;
+        return FILE_REQUEST;
+    } else if (m_range_count > 0) {
+        // 只映射请求的区间
+        if (!map_ranges(entry->fd)) {
+            unmap();
+            return INTERNAL_ERROR;
+        }
         return FILE_REQUEST;
     } else {
         // mmap+writev
-        m_file_address = (char*)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-        close(fd);
+        if (m_file_size > 0) {
+            void* addr = mmap(0, m_file_size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+            if (addr == MAP_FAILED) {
+                unmap();
+                return INTERNAL_ERROR;
+            }
+            m_file_address = (char*)addr;
+        }
         return FILE_REQUEST;
     }
 }
 
-bool HTTPConn::write() {
-    int temp = 0;
-    [[maybe_unused]]int bytes_sent = 0; // 当前发送字节
-    if (m_bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        init();
-        return true;
+// 解析非负十进制整数，不接受符号和溢出
+static bool parse_offset(const char** p, off_t* out) {
+    const char* s = *p;
+    if (*s < '0' || *s > '9') {
+        return false;
+    }
+    off_t v = 0;
+    for (; *s >= '0' && *s <= '9'; s++) {
+        if (v > (INT64_MAX - 9) / 10) {
+            return false;
+        }
+        v = v * 10 + (*s - '0');
     }
+    *p = s;
+    *out = v;
+    return true;
+}
 
-    while (1) {
-        if (cfg.use_sendfile) {
-            if (m_iv_count > 0) {
-                temp = writev(m_sockfd, m_iv, m_iv_count);
+// 解析Range头部（只支持bytes单位），满足条件的区间按请求中的顺序放入m_ranges（从m_pool借用）
+// 返回区间数；0表示忽略Range（语法错误、区间过多或内存不足），返回整个文件；-1表示没有一个区间与文件重叠
+int HTTPConn::parse_ranges(off_t size) {
+    const char* p = m_range;
+    if (strncasecmp(p, "bytes=", 6) != 0) {
+        return 0;
+    }
+    if (!m_ranges) {
+        m_ranges = (ByteRange*)m_pool->alloc(BufferPool::min_size());
+        if (!m_ranges) {
+            return 0;
+        }
+    }
+    p += 6;
+    int count = 0;
+    while (true) {
+        p += strspn(p, " \t");
+        off_t first, last;
+        if (*p == '-') {
+            // 后缀形式：最后n个字节
+            p++;
+            off_t n;
+            if (!parse_offset(&p, &n)) {
+                return 0;
+            }
+            first = n >= size ? 0 : size - n;
+            last = n == 0 ? first - 1 : size - 1;
+        } else {
+            if (!parse_offset(&p, &first) || *p++ != '-') {
+                return 0;
+            }
+            if (*p >= '0' && *p <= '9') {
+                if (!parse_offset(&p, &last) || last < first) {
+                    return 0;
+                }
+                last = std::min(last, size - 1);
             } else {
-                temp = sendfile(m_sockfd, m_filefd, nullptr, m_file_stat.st_size);
+                last = size - 1;
+            }
+        }
+        if (first < size && first <= last) {
+            if (count == MAX_RANGES) {
+                return 0;
             }
+            ByteRange& r = m_ranges[count++];
+            r.first = first;
+            r.last = last;
+            r.map = NULL;
+            r.map_len = 0;
+            r.data = NULL;
+        }
+        p += strspn(p, " \t");
+        if (*p == '\0') {
+            break;
+        }
+        if (*p++ != ',') {
+            return 0;
+        }
+    }
+    return count > 0 ? count : -1;
+}
+
+// 在url旁边的预压缩文件中选择一个（br优先），压缩文件不比原文件旧时用它的条目替换*entry
+// 返回false表示需要阻塞（run-to-completion模式下缓存未命中），此时*entry不变
+bool HTTPConn::select_encoding(const char* url, FileCache::Entry** entry, int usable) {
+    static const struct {
+        int bit;
+        const char* suffix;
+        const char* name;
+    } kinds[] = {
+        { FileCache::ENCODING_BR, ".br", "br" },
+        { FileCache::ENCODING_GZIP, ".gz", "gzip" }
+    };
+    char path[FILENAME_LEN + 4];
+    size_t len = strlen(url);
+    memcpy(path, url, len);
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (!(usable & kinds[i].bit)) {
+            continue;
+        }
+        memcpy(path + len, kinds[i].suffix, 4);
+        FileCache::Entry* sibling = NULL;
+        if (m_run_inline) {
+            if (!file_cache.lookup(path, &sibling)) {
+                return false;
+            }
+        } else if (file_cache.acquire(path, &sibling) != FileCache::FILE_OK) {
+            continue;
+        }
+        if (sibling->st.st_mtime >= (*entry)->st.st_mtime) {
+            FileCache::release(*entry);
+            *entry = sibling;
+            m_content_encoding = kinds[i].name;
+            return true;
+        }
+        FileCache::release(sibling);
+    }
+    return true;
+}
+
+// 解析IMF-fixdate格式的HTTP日期（如 Sun, 06 Nov 1994 08:49:37 GMT），其他格式视为无效
+static bool parse_http_date(const char* text, time_t* out) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(text, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end || *end != '\0') {
+        return false;
+    }
+    *out = timegm(&tm);
+    return true;
+}
+
+// If-None-Match的值（实体标签列表或*）中是否有与etag匹配的项，按弱比较（忽略W/前缀）
+static bool etag_list_matches(const char* list, const char* etag) {
+    size_t etag_len = strlen(etag);
+    const char* p = list;
+    while (true) {
+        p += strspn(p, " \t,");
+        if (*p == '\0') {
+            return false;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        if (*p != '"') {
+            return false;
+        }
+        const char* close = strchr(p + 1, '"');
+        if (!close) {
+            return false;
+        }
+        if ((size_t)(close + 1 - p) == etag_len && memcmp(p, etag, etag_len) == 0) {
+            return true;
+        }
+        p = close + 1;
+    }
+}
+
+// 条件GET：有If-None-Match时只看它，否则比较If-Modified-Since与文件的修改时间（秒）
+bool HTTPConn::not_modified(const FileCache::Entry* entry) const {
+    if (m_if_none_match) {
+        return etag_list_matches(m_if_none_match, entry->etag);
+    }
+    time_t since;
+    if (m_if_modified_since && parse_http_date(m_if_modified_since, &since)) {
+        return entry->st.st_mtime <= since;
+    }
+    return false;
+}
+
+// If-Range：只有文件没有改变时Range才有效，否则返回整个文件
+// 实体标签按强比较（弱标签不匹配），日期与文件的修改时间比较
+bool HTTPConn::if_range_matches(const FileCache::Entry* entry) const {
+    if (!m_if_range) {
+        return true;
+    }
+    if (m_if_range[0] == '"') {
+        return strcmp(m_if_range, entry->etag) == 0;
+    }
+    time_t date;
+    return parse_http_date(m_if_range, &date) && date == entry->st.st_mtime;
+}
+
+// mmap方式：每个区间只映射覆盖它的页，不映射（也不会读入）请求范围以外的部分
+bool HTTPConn::map_ranges(int fd) {
+    static const off_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+    for (int i = 0; i < m_range_count; i++) {
+        ByteRange& r = m_ranges[i];
+        off_t start = r.first & ~page_mask;
+        size_t len = r.last + 1 - start;
+        void* addr = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, start);
+        if (addr == MAP_FAILED) {
+            return false;
+        }
+        r.map = (char*)addr;
+        r.map_len = len;
+        r.data = r.map + (r.first - start);
+    }
+    return true;
+}
+
+// 区间已经转交给响应（或请求出错）：把区间数组还给内存池
+void HTTPConn::release_ranges() {
+    static_assert(MAX_RANGES * sizeof(ByteRange) <= (size_t)1 << BufferPool::MIN_SHIFT,
+                  "m_ranges must fit in the smallest BufferPool block");
+    if (m_ranges) {
+        m_pool->free((char*)m_ranges, BufferPool::min_size());
+        m_ranges = NULL;
+    }
+    m_range_count = 0;
+}
+
+// 返回false表示需要关闭写端（出错或Connection: close），见send_responses
+// 只在reactor线程中调用（EPOLLOUT、就绪列表或请求在reactor内处理完毕）
+bool HTTPConn::write() {
+    // 在这里继续发送后，就绪列表中的旧条目作废（额度再次用完时会重新加入）
+    m_ready_queued = false;
+    return send_responses() != WRITE_CLOSING;
+}
+
+// 依次发送响应队列中的响应：相邻的内存中的响应合并为一次writev，遇到sendfile的响应体时在其后断开
+// 每次调用最多发送write_budget，用完时让出（见yield_write），避免一个大响应阻塞同一reactor上的其他连接
+// 除WRITE_MORE_INPUT外都已经重新注册了事件，工作线程中调用时之后不能再访问连接
+HTTPConn::WRITE_RESULT HTTPConn::send_responses() {
+    if (m_uring) {
+        // 由reactor提交sendmsg，完成后调用send_done
+        rearm(EPOLLOUT);
+        return WRITE_BLOCKED;
+    }
+    if (m_resp_head == m_resp_count) {
+        release_responses();
+        rearm(EPOLLIN);
+        return WRITE_DONE;
+    }
+
+    size_t budget = m_ready ? (size_t)live_cfg().write_budget * 1024 : 0;
+    size_t sent = 0;
+    while (m_resp_head < m_resp_count) {
+        if (budget > 0 && sent >= budget) {
+            set_timeout(TIMEOUT_WRITE);
+            yield_write();
+            return WRITE_BLOCKED;
+        }
+        Response& r = m_resp[m_resp_head];
+        size_t mem_len = r.header_len + r.body_len;
+        // 单次调用也不超过剩余的额度（回环上一次writev/sendfile就可能发送数MB）
+        size_t limit = budget > 0 ? budget - sent : SIZE_MAX;
+        ssize_t temp;
+        if (r.sent >= mem_len) {
+            // 头部已发送完毕，文件部分用sendfile发送
+            temp = sendfile(m_sockfd, r.filefd, &r.file_off, std::min(r.file_len - (r.sent - mem_len), limit));
         } else {
-            temp = writev(m_sockfd, m_iv, m_iv_count);
+            struct iovec iv[2 * MAX_PIPELINE_DEPTH];
+            bool file_follows;
+            int iv_count = build_iov(iv, 2 * MAX_PIPELINE_DEPTH, &file_follows);
+            for (int i = 0; i < iv_count; i++) {
+                if (iv[i].iov_len >= limit) {
+                    iv[i].iov_len = limit;
+                    iv_count = i + 1;
+                    break;
+                }
+                limit -= iv[i].iov_len;
+            }
+            if (file_follows) {
+                // 之后紧接着sendfile：MSG_MORE让内核暂不发出不满一个报文段的响应头，与文件开头合并为同一个报文段
+                // （否则在TCP_NODELAY下响应头会单独成为一个小报文段）
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iv;
+                msg.msg_iovlen = iv_count;
+                temp = sendmsg(m_sockfd, &msg, MSG_MORE);
+            } else {
+                temp = writev(m_sockfd, iv, iv_count);
+            }
         }
         // send failed
         if (temp < 0) {
             if (errno == EAGAIN) {
-                // 没有缓冲区空间，等待下一轮事件
-                modfd(m_epollfd, m_sockfd, EPOLLOUT);
-                return true;
+                // 没有缓冲区空间，等待下一轮事件；每次有进展都重新计算发送超时
+                set_timeout(TIMEOUT_WRITE);
+                rearm(EPOLLOUT);
+                return WRITE_BLOCKED;
             }
             DPRINT("[%d.%d]Write error: %s", m_epollfd, m_sockfd, strerror(errno));
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN);   // RDHUP
-            return false;
+            release_responses();
+            set_timeout(TIMEOUT_WRITE);
+            rearm_closing();
+            return WRITE_CLOSING;
         } else if (temp == 0) {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN); 
-            return false;
+            release_responses();
+            set_timeout(TIMEOUT_WRITE);
+            rearm_closing();
+            return WRITE_CLOSING;
         }
-        bytes_sent += temp;
-        m_bytes_to_send -= temp;
-
-        // iovec adjust
-        if (temp > 0) {
-            int i = 0;
-            while (temp > 0 && i < m_iv_count) {
-                if (m_iv[i].iov_len > (size_t)temp) {
-                    m_iv[i].iov_len -= temp;
-                    m_iv[i].iov_base = (char*)m_iv[i].iov_base + temp;
-                    temp = 0;
-                } else {
-                    temp -= m_iv[i].iov_len;
-                    i++;
-                }
-            }
-            if (i > 0) {
-                for (int j = i; j < m_iv_count; j++) {
-                    m_iv[j - i] = m_iv[j];
-                }
-                m_iv_count -= i;
+        DPRINT("[%d.%d]Bytes sent: %ld", m_epollfd, m_sockfd, (long)temp);
+        advance(temp);
+        sent += temp;
+    }
+    return finish_write();
+}
+
+// 发送额度用完但套接字仍然可写：边沿触发下不会再有EPOLLOUT，
+// reactor线程中加入就绪列表，由reactor处理完本轮其他事件后继续发送；
+// 工作线程中以EPOLLONESHOT重新注册EPOLLOUT，MOD时套接字可写，reactor立即收到事件
+void HTTPConn::yield_write() {
+    metrics.add(Metrics::WRITE_YIELDS);
+    if (m_in_worker.load(std::memory_order_relaxed) > 0) {
+        rearm(EPOLLOUT);
+        return;
+    }
+    if (!m_ready_queued) {
+        m_ready_queued = true;
+        m_ready->push_back(this);
+    }
+}
+
+// 发送结束并且需要关闭写端，等待对端关闭（RDHUP）
+// 工作线程中rearm之后连接随时可能被reactor关闭，所以在这里先关闭写端；reactor线程中由write()的调用者关闭
+void HTTPConn::rearm_closing() {
+    if (m_in_worker.load(std::memory_order_relaxed) > 0) {
+        close_conn_write();
+    }
+    rearm(EPOLLIN);
+}
+
+// 本批响应全部发送完毕，根据最后一个响应的Connection字段决定是否关闭连接
+HTTPConn::WRITE_RESULT HTTPConn::finish_write() {
+    uint64_t now = Metrics::now_ns();
+    metrics.record(Metrics::PHASE_WRITE, now - m_write_ns);
+    if (m_batch_ns != 0) {
+        metrics.record(Metrics::PHASE_TOTAL, now - m_batch_ns);
+        m_batch_ns = 0;
+    }
+    release_responses();
+    if (!m_last_linger) {
+        // 等待对端关闭的时间同样受write_timeout限制
+        set_timeout(TIMEOUT_WRITE);
+        rearm_closing();
+        DPRINT("[%d.%d]Connection: close", m_epollfd, m_sockfd);
+        return WRITE_CLOSING;   // 在RDHUP处关闭连接
+    }
+    if (m_end_pos > 0) {
+        // 缓冲区中还有后续请求的数据，由调用者继续处理（见has_pending_input），
+        // 此时不能重新注册EPOLLIN，否则可能有两个线程同时处理这个连接
+        return WRITE_MORE_INPUT;
+    }
+    set_timeout(TIMEOUT_IDLE);
+    rearm(EPOLLIN);
+    return WRITE_DONE;
+}
+
+// io_uring：填充待发送的数据，*close_after表示这些数据包含最后一个响应并且之后要关闭连接
+int HTTPConn::send_iov(struct iovec* iv, int max, bool* close_after) {
+    int count = build_iov(iv, max);
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++) {
+        bytes += iv[i].iov_len;
+    }
+    size_t remain = 0;
+    for (int i = m_resp_head; i < m_resp_count; i++) {
+        remain += m_resp[i].header_len + m_resp[i].body_len + m_resp[i].file_len - m_resp[i].sent;
+    }
+    *close_after = count > 0 && bytes == remain && !m_resp[m_resp_count - 1].linger;
+    return count;
+}
+
+// io_uring：reactor提交的sendmsg完成，n为发送的字节数或负的错误码，返回值同write()
+bool HTTPConn::send_done(ssize_t n) {
+    if (m_resp_head == m_resp_count) {
+        release_responses();
+        rearm(EPOLLIN);
+        return true;
+    }
+    if (n <= 0) {
+        DPRINT("[%d.%d]Write error: %s", m_epollfd, m_sockfd, strerror(-n));
+        release_responses();
+        set_timeout(TIMEOUT_WRITE);
+        rearm(EPOLLIN);     // RDHUP
+        return false;
+    }
+    advance(n);
+    if (m_resp_head < m_resp_count) {
+        // 还有没发送的响应
+        set_timeout(TIMEOUT_WRITE);
+        rearm(EPOLLOUT);
+        return true;
+    }
+    return finish_write() != WRITE_CLOSING;
+}
+
+// 从第一个未发送完的响应开始填充iovec，直到遇到需要sendfile的响应体或iovec用完
+int HTTPConn::build_iov(struct iovec* iv, int max, bool* file_follows) {
+    int count = 0;
+    if (file_follows) {
+        *file_follows = false;
+    }
+    for (int i = m_resp_head; i < m_resp_count && count + 2 <= max; i++) {
+        const Response& r = m_resp[i];
+        size_t skip = r.sent;   // 只有第一个响应可能已经部分发送
+        if (skip < (size_t)r.header_len) {
+            iv[count].iov_base = m_write_buf + r.header_off + skip;
+            iv[count].iov_len = r.header_len - skip;
+            count++;
+            skip = 0;
+        } else {
+            skip -= r.header_len;
+        }
+        if (skip < r.body_len) {
+            iv[count].iov_base = (char*)r.body + skip;
+            iv[count].iov_len = r.body_len - skip;
+            count++;
+        }
+        if (r.file_len > 0) {
+            if (file_follows) {
+                *file_follows = true;
             }
+            break;
         }
+    }
+    return count;
+}
 
-        if (m_bytes_to_send <= 0) {
-            // 根据Connection字段决定是否立即关闭连接
-            DPRINT("[%d.%d]Bytes sent: %d", m_epollfd, m_sockfd, bytes_sent);
-            if (m_bytes_to_send < 0) {
-                DPRINT("!WARNING!Bytes sent not match, bytes_remain = %d", m_bytes_to_send);
-            }
-            unmap();
-            if (m_linger) {
-                init();
-                modfd(m_epollfd, m_sockfd, EPOLLIN);
-                return true;
-            } else {
-                modfd(m_epollfd, m_sockfd, EPOLLIN);
-                DPRINT("[%d.%d]Connection: close", m_epollfd, m_sockfd);
-                return false;   // 在RDHUP处关闭连接
-            }
+// 记录已发送的n个字节，释放发送完毕的响应
+void HTTPConn::advance(size_t n) {
+    metrics.add(Metrics::BYTES_SENT, n);
+    while (n > 0 && m_resp_head < m_resp_count) {
+        Response& r = m_resp[m_resp_head];
+        size_t total = r.header_len + r.body_len + r.file_len;
+        size_t take = std::min(n, total - r.sent);
+        r.sent += take;
+        n -= take;
+        if (r.sent < total) {
+            break;
         }
+        m_last_linger = r.linger;
+        finish_response(r);
+        m_resp_head++;
     }
 }
 
-bool HTTPConn::add_response(const char* fmt, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE) {
+// 在写缓冲区末尾追加len个字节，空间不够时换用更大的块
+bool HTTPConn::append(const char* data, size_t len) {
+    if (!ensure_write_buf()) {
         return false;
     }
-    va_list arg_list;
-    va_start(arg_list, fmt);
-    int len = vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, fmt, arg_list);
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx)) {
-        return false;
+    while ((size_t)(m_write_size - m_write_idx) < len) {
+        if (!grow_write_buf()) {
+            return false;
+        }
     }
+    memcpy(m_write_buf + m_write_idx, data, len);
     m_write_idx += len;
-    va_end(arg_list);
     return true;
 }
+bool HTTPConn::append_uint(uint64_t v) {
+    char buf[UINT_DIGITS_MAX];
+    return append(buf, format_uint(buf, v));
+}
 
+// 状态行以及Date头部（每个响应都有）
 bool HTTPConn::add_status_line(int status, const char* title) {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    metrics.count_status(status);
+    m_status = status;
+    size_t date_len;
+    const char* date = date_header(&date_len);
+    return append_literal("HTTP/1.1 ") && append_uint(status) && append_literal(" ")
+        && append(title) && append_literal("\r\n") && append(date, date_len);
 }
-bool HTTPConn::add_headers(int content_len) {
+bool HTTPConn::add_headers(long long content_len) {
     bool ret = true;
     ret = add_content_length(content_len);
     ret = ret && add_linger();
     ret = ret && add_blank_line();
     return ret;
 }
-bool HTTPConn::add_content_length(int content_len) {
-    return add_response("Content-Length: %d\r\n", content_len);
+bool HTTPConn::add_content_length(long long content_len) {
+    return append_literal("Content-Length: ") && append_uint(content_len) && append_literal("\r\n");
 }
 bool HTTPConn::add_linger() {
-    return add_response("Connection: %s\r\n", m_linger ? "keep-alive" : "close");
+    return m_linger ? append_literal("Connection: keep-alive\r\n") : append_literal("Connection: close\r\n");
 }
-bool HTTPConn::add_blank_line() {
-    return add_response("\r\n");
+bool HTTPConn::add_accept_ranges() {
+    return append_literal("Accept-Ranges: bytes\r\n");
+}
+// 发送预压缩文件时的Content-Encoding，以及资源有压缩版本时的Vary（原文件的响应同样需要）
+bool HTTPConn::add_encoding() {
+    bool ret = true;
+    if (m_content_encoding) {
+        ret = append_literal("Content-Encoding: ") && append(m_content_encoding) && append_literal("\r\n");
+    }
+    if (m_vary) {
+        ret = ret && append_literal("Vary: Accept-Encoding\r\n");
+    }
+    return ret;
+}
+// 当前请求文件的ETag和Last-Modified
+bool HTTPConn::add_validators() {
+    return append_literal("ETag: ") && append(m_file_entry->etag) && append_literal("\r\nLast-Modified: ")
+        && append(m_file_entry->last_modified) && append_literal("\r\n");
 }
-bool HTTPConn::add_content(const char* content) {
-    return add_response("%s", content);
+bool HTTPConn::add_blank_line() {
+    return append_literal("\r\n");
 }
+// 生成一个响应并追加到响应队列末尾，当前请求持有的文件资源转交给该响应
 bool HTTPConn::process_write(HTTP_CODE ret) {
+    if (!ensure_responses() || m_resp_count >= m_resp_cap) {
+        return false;
+    }
+    int header_off = m_write_idx;
+    const char* body = NULL;
+    size_t body_len = 0;
+    bool use_sendfile = false;
     switch(ret) {
-        case INTERNAL_ERROR: {
-            add_status_line(500, ERROR_500_TITLE);
-            add_headers(strlen(ERROR_500_FORM));
-            if (!add_content(ERROR_500_FORM)) {
-                return false;
-            }
-            break;
-        }
-        case BAD_REQUEST: {
-            add_status_line(400, ERROR_400_TITLE);
-            add_headers(strlen(ERROR_400_FORM));
-            if (!add_content(ERROR_400_FORM)) {
+        case INTERNAL_ERROR:
+        case BAD_REQUEST:
+        case NO_RESOURCE:
+        case FORBIDDEN_REQUEST:
+        case SERVICE_UNAVAILABLE: {
+            // 写缓冲区中只有状态行和Date，其余部分直接引用预先序列化的静态内容
+            const StaticResponse* sr = ret == INTERNAL_ERROR ? &s_error_500
+                                     : ret == BAD_REQUEST ? &s_error_400
+                                     : ret == NO_RESOURCE ? &s_error_404
+                                     : ret == FORBIDDEN_REQUEST ? &s_error_403
+                                     : &s_error_503;
+            if (!add_status_line(sr->status, sr->title)) {
                 return false;
             }
+            body = sr->tail[m_linger].data();
+            body_len = sr->tail[m_linger].size();
             break;
         }
-        case NO_RESOURCE: {
-            add_status_line(404, ERROR_404_TITLE);
-            add_headers(strlen(ERROR_404_FORM));
-            if (!add_content(ERROR_404_FORM)) {
+        case STATS_REQUEST: {
+            // 统计数据在这里生成，与响应头一起放在写缓冲区中
+            char stats[STATS_BODY_MAX];
+            bool prometheus = strcmp(m_url, STATS_PROMETHEUS_URL) == 0;
+            size_t len = prometheus ? metrics.render_prometheus(stats, sizeof(stats))
+                                    : metrics.render_json(stats, sizeof(stats));
+            add_status_line(200, OK_200_TITLE);
+            append_literal("Content-Type: ");
+            append(prometheus ? "text/plain; version=0.0.4" : "application/json");
+            append_literal("\r\nCache-Control: no-store\r\n");
+            add_headers(len);
+            if (!append(stats, len)) {
                 return false;
             }
             break;
         }
-        case FORBIDDEN_REQUEST: {
-            add_status_line(403, ERROR_403_TITLE);
-            add_headers(strlen(ERROR_403_FORM));
-            if (!add_content(ERROR_403_FORM)) {
+        case RANGE_NOT_SATISFIABLE: {
+            add_status_line(416, ERROR_416_TITLE);
+            append_literal("Content-Range: bytes */");
+            append_uint(m_file_size);
+            append_literal("\r\n");
+            add_headers(strlen(ERROR_416_FORM));
+            if (!append(ERROR_416_FORM)) {
                 return false;
             }
             break;
         }
-        case SERVICE_UNAVAILABLE: {
-            add_status_line(503, ERROR_503_TITLE);
-            add_headers(strlen(ERROR_503_FORM));
-            if (!add_content(ERROR_503_FORM)) {
+        case NOT_MODIFIED: {
+            // 304没有响应体，也不带Content-Length
+            add_status_line(304, NOT_MODIFIED_304_TITLE);
+            add_validators();
+            add_encoding();
+            add_linger();
+            if (!add_blank_line()) {
                 return false;
             }
             break;
         }
         case FILE_REQUEST: {
+            if (m_range_count > 0) {
+                return add_range_responses(header_off);
+            }
+            if (m_content_entry) {
+                // 缓存命中：状态行之后的部分已经完整序列化
+                if (!add_status_line(200, OK_200_TITLE)) {
+                    return false;
+                }
+                body = m_content_entry->data;
+                body_len = m_content_entry->len;
+                break;
+            }
             add_status_line(200, OK_200_TITLE);
-            if (m_file_stat.st_size != 0) {
-                add_headers(m_file_stat.st_size);
-                m_iv[0].iov_base = m_write_buf;
-                m_iv[0].iov_len = m_write_idx;
-                if (cfg.use_sendfile) {
-                    m_iv_count = 1;
+            add_validators();
+            add_encoding();
+            add_accept_ranges();
+            if (m_file_size != 0) {
+                if (!add_headers(m_file_size)) {
+                    return false;
+                }
+                if (m_filefd != -1) {
+                    use_sendfile = true;
                 } else {
-                    m_iv[1].iov_base = m_file_address;
-                    m_iv[1].iov_len = m_file_stat.st_size;
-                    m_iv_count = 2;
+                    body = m_file_address;
+                    body_len = m_file_size;
                 }
-                m_bytes_to_send = m_write_idx + m_file_stat.st_size;    // 发送字节数
-                return true;
             } else {
                 const char* OK_STR = "<html><body></body></html>";
                 add_headers(strlen(OK_STR));
-                if (!add_content(OK_STR)) {
+                if (!append(OK_STR)) {
                     return false;
                 }
             }
@@ -613,61 +1668,362 @@ bool HTTPConn::process_write(HTTP_CODE ret) {
         default:
         return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_bytes_to_send = m_write_idx;
-    m_iv_count = 1;
+
+    Response& r = push_response(header_off);
+    r.body = body;
+    r.body_len = body_len;
+    if (use_sendfile) {
+        r.filefd = m_filefd;
+        r.file_len = m_file_size;
+    }
+    r.mmap_addr = m_file_address;
+    r.mmap_len = m_file_size;
+    r.file_entry = m_file_entry;
+    r.content_entry = m_content_entry;
+    m_file_address = 0;
+    m_filefd = -1;
+    m_file_entry = NULL;
+    m_content_entry = NULL;
     return true;
 }
 
+// 在响应队列末尾追加一项，响应头为写缓冲区中从header_off到当前位置的内容，其余字段由调用者填写
+HTTPConn::Response& HTTPConn::push_response(int header_off) {
+    Response& r = m_resp[m_resp_count++];
+    r.header_off = header_off;
+    r.header_len = m_write_idx - header_off;
+    r.body = NULL;
+    r.body_len = 0;
+    r.filefd = -1;
+    r.file_off = 0;
+    r.file_len = 0;
+    r.sent = 0;
+    r.mmap_addr = NULL;
+    r.mmap_len = 0;
+    r.file_entry = NULL;
+    r.content_entry = NULL;
+    r.linger = m_linger;
+    return r;
+}
+
+// multipart分隔串：对计数器做splitmix64混合，每个响应不同，且几乎不可能出现在文件内容中
+static uint64_t next_boundary() {
+    static std::atomic<uint64_t> s_seq((uint64_t)time(NULL) << 20);
+    uint64_t z = s_seq.fetch_add(0x9E3779B97F4A7C15ULL, std::memory_order_relaxed) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static const size_t BOUNDARY_LEN = 16;
+// "first-last/size"的最大长度
+static const size_t RANGE_SPEC_MAX = 3 * UINT_DIGITS_MAX + 2;
+
+static size_t format_range(char* buf, off_t first, off_t last, off_t size) {
+    char* p = buf;
+    p += format_uint(p, first);
+    *p++ = '-';
+    p += format_uint(p, last);
+    *p++ = '/';
+    p += format_uint(p, size);
+    return p - buf;
+}
+
+// multipart中一个区间之前的分隔行和头部，第一个区间前没有\r\n
+static const char PART_PREFIX[] = "\r\n--";
+static const char PART_RANGE[] = "\r\nContent-Range: bytes ";
+static const char PART_END[] = "\r\n\r\n";
+static const size_t PART_HEADER_MAX = sizeof(PART_PREFIX) + BOUNDARY_LEN + sizeof(PART_RANGE)
+                                    + RANGE_SPEC_MAX + sizeof(PART_END);
+
+static size_t format_part_header(char* buf, const char* boundary, bool first_part,
+                                 off_t first, off_t last, off_t size) {
+    char* p = buf;
+    size_t skip = first_part ? 2 : 0;
+    memcpy(p, PART_PREFIX + skip, sizeof(PART_PREFIX) - 1 - skip);
+    p += sizeof(PART_PREFIX) - 1 - skip;
+    memcpy(p, boundary, BOUNDARY_LEN);
+    p += BOUNDARY_LEN;
+    memcpy(p, PART_RANGE, sizeof(PART_RANGE) - 1);
+    p += sizeof(PART_RANGE) - 1;
+    p += format_range(p, first, last, size);
+    memcpy(p, PART_END, sizeof(PART_END) - 1);
+    p += sizeof(PART_END) - 1;
+    return p - buf;
+}
+
+// 206响应：单个区间直接作为响应体；多个区间使用multipart/byteranges
+// 多区间时每个区间（连同它前面的分隔行和Content-Range）在响应队列中占一项，最后一项是结束分隔行，
+// 这样每个区间都能像普通响应体一样用sendfile（显式偏移）或mmap窗口发送，不需要复制文件内容；
+// 除最后一项外linger都为true，连接是否关闭由最后一项决定，文件缓存条目也由最后一项持有
+bool HTTPConn::add_range_responses(int header_off) {
+    int parts = m_range_count;
+    if (m_resp_count + parts + (parts > 1 ? 1 : 0) > m_resp_cap) {
+        return false;
+    }
+    off_t size = m_file_size;
+    char boundary[BOUNDARY_LEN];
+    char part[PART_HEADER_MAX];
+    long long content_len = 0;
+    add_status_line(206, PARTIAL_206_TITLE);
+    add_validators();
+    add_encoding();
+    if (parts == 1) {
+        append_literal("Content-Range: bytes ");
+        append(part, format_range(part, m_ranges[0].first, m_ranges[0].last, size));
+        append_literal("\r\n");
+        content_len = m_ranges[0].last - m_ranges[0].first + 1;
+    } else {
+        format_hex64(boundary, next_boundary());
+        for (int i = 0; i < parts; i++) {
+            content_len += format_part_header(part, boundary, i == 0, m_ranges[i].first, m_ranges[i].last, size);
+            content_len += m_ranges[i].last - m_ranges[i].first + 1;
+        }
+        // 结束分隔行："\r\n--" boundary "--\r\n"
+        content_len += 4 + BOUNDARY_LEN + 4;
+        append_literal("Content-Type: multipart/byteranges; boundary=");
+        append(boundary, BOUNDARY_LEN);
+        append_literal("\r\n");
+    }
+    if (!add_headers(content_len)) {
+        return false;
+    }
+    for (int i = 0; i < parts; i++) {
+        ByteRange& br = m_ranges[i];
+        if (parts > 1) {
+            // 第一个区间的分隔行紧跟在响应头后面，属于同一项
+            if (i > 0) {
+                header_off = m_write_idx;
+            }
+            if (!append(part, format_part_header(part, boundary, i == 0, br.first, br.last, size))) {
+                return false;
+            }
+        }
+        Response& r = push_response(header_off);
+        size_t len = br.last - br.first + 1;
+        if (m_filefd != -1) {
+            r.filefd = m_filefd;
+            r.file_off = br.first;
+            r.file_len = len;
+        } else {
+            // 映射转交给响应，发送完毕后解除
+            r.body = br.data;
+            r.body_len = len;
+            r.mmap_addr = br.map;
+            r.mmap_len = br.map_len;
+            br.map = NULL;
+        }
+        if (parts > 1) {
+            r.linger = true;
+        }
+    }
+    if (parts > 1) {
+        header_off = m_write_idx;
+        if (!(append_literal("\r\n--") && append(boundary, BOUNDARY_LEN) && append_literal("--\r\n"))) {
+            return false;
+        }
+        push_response(header_off);
+    }
+    m_resp[m_resp_count - 1].file_entry = m_file_entry;
+    m_file_entry = NULL;
+    m_filefd = -1;
+    release_ranges();
+    return true;
+}
+
+// 为刚处理完的请求（从first_resp开始的响应）写一条访问日志，handle_ns为解析到生成响应的耗时
+void HTTPConn::log_access(int first_resp, uint64_t handle_ns) {
+    AccessRecord r;
+    memset(&r, 0, sizeof(r));
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r.time_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    for (int i = first_resp; i < m_resp_count; i++) {
+        r.bytes += m_resp[i].header_len + m_resp[i].body_len + m_resp[i].file_len;
+    }
+    r.client_addr = m_address.sin_addr.s_addr;
+    r.client_port = m_address.sin_port;
+    r.duration_us = (uint32_t)(handle_ns / 1000);
+    r.status = m_status;
+    r.method = m_method;
+    r.version = m_http_ver;
+    if (m_url) {
+        size_t len = strlen(m_url);
+        r.url_len = len < UINT16_MAX ? len : UINT16_MAX;
+        memcpy(r.url, m_url, std::min(len, (size_t)AccessRecord::URL_MAX));
+    }
+    access_log.log(r);
+}
+
+// 管线化：依次解析缓冲区中所有完整的请求，按顺序生成响应，之后由write()一次性批量发送
+// 返回CLOSED_CONNECTION表示连接已被关闭，DEFERRED_REQUEST表示需要交给线程池（仅run-to-completion模式），
+// NO_REQUEST表示没有可发送的响应（需要继续读取数据），GET_REQUEST表示响应队列非空
+HTTPConn::HTTP_CODE HTTPConn::process_requests() {
+    if (!ensure_responses()) {
+        abort_conn();
+        return CLOSED_CONNECTION;
+    }
+    // 每个请求只读一次时钟：上一个请求结束的时间就是下一个请求开始的时间
+    uint64_t start_ns = Metrics::now_ns();
+    if (m_batch_ns == 0) {
+        m_batch_ns = start_ns;
+    }
+    while (m_resp_count < m_resp_limit) {
+        HTTP_CODE read_ret;
+        if (m_deferred) {
+            // 请求已在reactor线程中解析完毕，只需完成文件相关的处理
+            m_deferred = false;
+            read_ret = do_request();
+        } else {
+            read_ret = process_read();
+        }
+        if (read_ret == NO_REQUEST) {
+            break;
+        }
+        if (read_ret == DEFERRED_REQUEST) {
+            // 前面已生成的响应留在队列中，由线程池继续处理
+            m_deferred = true;
+            return DEFERRED_REQUEST;
+        }
+        if (read_ret == BAD_REQUEST || read_ret == INTERNAL_ERROR) {
+            // 无法确定下一个请求从哪里开始，发送响应后关闭连接
+            m_linger = false;
+        }
+        DPRINT("[%d.%d]Done HTTP processing\n" \
+               "METHOD = %s\n" \
+               "Linger = %s\n" \
+               "" \
+               , m_epollfd, m_sockfd, get_method_name(m_method).c_str(), m_linger ? "Keep-Alive" : "Close"
+        );
+        int first_resp = m_resp_count;
+        if (!process_write(read_ret)) {
+            // 无法写入
+            abort_conn();
+            return CLOSED_CONNECTION;
+        }
+        uint64_t end_ns = Metrics::now_ns();
+        metrics.record(Metrics::PHASE_HANDLE, end_ns - start_ns);
+        if (access_log.enabled()) {
+            log_access(first_resp, end_ns - start_ns);
+        }
+        start_ns = end_ns;
+        bool linger = m_linger;
+        m_req_start = m_start_line;
+        reset_request();
+        if (!linger) {
+            // 之后的请求不再处理
+            break;
+        }
+    }
+    compact_read_buf();
+    if (m_resp_count > 0) {
+        // 进入发送阶段
+        m_write_ns = start_ns;
+        set_timeout(TIMEOUT_WRITE);
+        return GET_REQUEST;
+    }
+    if (m_end_pos > 0 && m_timeout_kind.load(std::memory_order_relaxed) != TIMEOUT_HEADER) {
+        // 新请求开始到达：从现在起计算请求头超时，之后收到的数据不再延长期限（防止slowloris）
+        set_timeout(TIMEOUT_HEADER);
+    }
+    return NO_REQUEST;
+}
+
 void HTTPConn::process() {
     DPRINT("[%d.%d]Processing", m_epollfd, m_sockfd);
-    HTTP_CODE read_ret = process_read();
-    if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN);
-        DPRINT("[%d.%d]Process not complete", m_epollfd, m_sockfd);
-        return;
+    metrics.record(Metrics::PHASE_QUEUE, Metrics::now_ns() - m_queued_ns);
+    m_run_inline = false;
+    while (true) {
+        HTTP_CODE ret = process_requests();
+        if (ret == NO_REQUEST) {
+            rearm(EPOLLIN);
+            DPRINT("[%d.%d]Process not complete", m_epollfd, m_sockfd);
+            break;
+        }
+        if (ret == CLOSED_CONNECTION) {
+            break;
+        }
+        // 直接尝试发送，只有套接字缓冲区满时才注册EPOLLOUT交给reactor，省去一次epoll_ctl和reactor的一次唤醒
+        // 除了还有后续请求的情况，发送后事件已经重新注册，reactor可能已经在处理这个连接
+        if (send_responses() != WRITE_MORE_INPUT) {
+            break;
+        }
+        // 超过pipeline_depth的后续请求已在缓冲区中，继续处理
     }
-    DPRINT("[%d.%d]Done HTTP processing\n" \
-           "METHOD = %s\n" \
-           "Linger = %s\n" \
-           "" \
-           , m_epollfd, m_sockfd, get_method_name(m_method).c_str(), m_linger ? "Keep-Alive" : "Close"
-    );
+    // 计数已在最后一次rearm中减一（见rearm_from_worker）
+}
 
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        // 无法写入
-        close_conn();
-        return;
+// run-to-completion模式：在reactor线程内直接解析请求并发送第一轮响应，省去线程池的一次跨线程交接
+// 返回false表示请求需要阻塞操作（如缓存未命中），调用者应将其交给线程池
+bool HTTPConn::process_inline() {
+    DPRINT("[%d.%d]Processing inline", m_epollfd, m_sockfd);
+    while (true) {
+        m_run_inline = true;
+        HTTP_CODE ret = process_requests();
+        m_run_inline = false;
+        if (ret == DEFERRED_REQUEST) {
+            return false;
+        }
+        if (ret == CLOSED_CONNECTION) {
+            return true;
+        }
+        if (ret == NO_REQUEST) {
+            rearm(EPOLLIN);
+            return true;
+        }
+        // 直接尝试发送，缓冲区满时write()会注册EPOLLOUT
+        if (!write()) {
+            close_conn_write();
+            return true;
+        }
+        if (!has_pending_input()) {
+            return true;
+        }
+        // 超过pipeline_depth的后续请求已在缓冲区中，继续处理
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
 }
 
 void HTTPConn::write_respond(HTTPConn::HTTP_CODE code, bool send_and_exit) {
+    if (send_and_exit) {
+        m_linger = false;
+    }
+    int first_resp = m_resp_count;
     bool write_ret = process_write(code);
+    m_write_ns = Metrics::now_ns();
     if (!write_ret) {
         // 无法写入
         close_conn();
         return;
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);
-    if (send_and_exit && m_linger) {
-        m_linger = false;
+    if (access_log.enabled()) {
+        log_access(first_resp, 0);
+    }
+    // 在reactor线程中调用，直接尝试发送
+    if (!write()) {
+        close_conn_write();
     }
 }
 
 void HTTPConn::unmap(){
-    if (cfg.use_sendfile) {
-        if (m_filefd != -1) {
-            int tmp = m_filefd;
-            m_filefd = -1;
-            close(tmp);
-        }
-    } else {
-        if (m_file_address) {
-            munmap(m_file_address, m_file_stat.st_size);
-            m_file_address = 0;
+    if (m_file_address) {
+        munmap(m_file_address, m_file_size);
+        m_file_address = 0;
+    }
+    for (int i = 0; i < m_range_count; i++) {
+        if (m_ranges[i].map) {
+            munmap(m_ranges[i].map, m_ranges[i].map_len);
+            m_ranges[i].map = NULL;
         }
     }
-}
+    release_ranges();
+    // sendfile使用的fd归FileCache所有，这里只归还引用
+    m_filefd = -1;
+    if (m_content_entry) {
+        ContentCache::release(m_content_entry);
+        m_content_entry = NULL;
+    }
+    if (m_file_entry) {
+        FileCache::release(m_file_entry);
+        m_file_entry = NULL;
+    }
+}
\ No newline at end of file
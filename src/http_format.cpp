@@ -0,0 +1,64 @@
+#include "http_format.h"
+#include <string.h>
+#include <time.h>
+
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+size_t format_uint(char* buf, uint64_t v) {
+    // 从低位向高位写入临时缓冲区，再整体复制
+    char tmp[UINT_DIGITS_MAX];
+    char* p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        unsigned i = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    }
+    if (v < 10) {
+        *--p = (char)('0' + v);
+    } else {
+        unsigned i = (unsigned)v * 2;
+        *--p = DIGIT_PAIRS[i + 1];
+        *--p = DIGIT_PAIRS[i];
+    }
+    size_t len = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, len);
+    return len;
+}
+
+void format_hex64(char* buf, uint64_t v) {
+    static const char HEX[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--) {
+        buf[i] = HEX[v & 0xF];
+        v >>= 4;
+    }
+}
+
+// 每个线程（reactor、工作线程）各自缓存，不需要同步
+static __thread time_t t_date_sec = -1;
+static __thread char t_date_buf[48];
+static __thread size_t t_date_len;
+
+const char* date_header(size_t* len) {
+    // 粗粒度实时时钟（vDSO实现，不陷入内核），精度只需要到秒
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != t_date_sec) {
+        struct tm tm;
+        gmtime_r(&ts.tv_sec, &tm);
+        t_date_len = strftime(t_date_buf, sizeof(t_date_buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        t_date_sec = ts.tv_sec;
+    }
+    *len = t_date_len;
+    return t_date_buf;
+}
@@ -0,0 +1,310 @@
+#include "http_scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+// 扫描头部块的中间状态，由各实现共享
+struct HeaderScanState {
+    size_t line;    // 当前行的起始位置
+    long colon;     // 当前行第一个冒号的位置，-1表示还没有遇到
+    int n;          // 已找到的头部行数
+};
+
+static const int SCAN_CONTINUE = -3;
+
+// 处理位于pos的\r或\n：完成当前行（或遇到空行时结束扫描）
+// 返回SCAN_CONTINUE表示需要继续扫描，否则为scan_headers的返回值
+static inline __attribute__((always_inline))
+int end_of_line(HeaderScanState& st, const char* buf, size_t len, size_t pos,
+                HeaderSpan* spans, int max, size_t* consumed) {
+    if (buf[pos] == '\n') {
+        return SCAN_BAD;
+    }
+    if (pos + 1 >= len) {
+        return SCAN_INCOMPLETE;
+    }
+    if (buf[pos + 1] != '\n') {
+        return SCAN_BAD;
+    }
+    if (pos == st.line) {
+        // 空行，头部结束
+        *consumed = pos + 2;
+        return st.n;
+    }
+    if (st.n == max) {
+        return SCAN_INCOMPLETE;
+    }
+    HeaderSpan& span = spans[st.n++];
+    span.name_off = st.line;
+    if (st.colon >= 0) {
+        size_t v = st.colon + 1;
+        while (v < pos && (buf[v] == ' ' || buf[v] == '\t')) {
+            v++;
+        }
+        span.name_len = st.colon - st.line;
+        span.value_off = v;
+        span.value_len = pos - v;
+    } else {
+        span.name_len = pos - st.line;
+        span.value_off = -1;
+        span.value_len = 0;
+    }
+    st.line = pos + 2;
+    st.colon = -1;
+    return SCAN_CONTINUE;
+}
+
+// 处理一个块（base开始）中的分隔符，eol和colon为该块中\r/\n和':'的位掩码
+static inline __attribute__((always_inline))
+int consume_block(HeaderScanState& st, const char* buf, size_t len, size_t base,
+                  uint32_t eol, uint32_t colon, HeaderSpan* spans, int max, size_t* consumed) {
+    uint32_t all = eol | colon;
+    while (all) {
+        int bit = __builtin_ctz(all);
+        all &= all - 1;
+        size_t pos = base + bit;
+        if (pos < st.line) {
+            // 上一行\r\n中的\n
+            continue;
+        }
+        if (!((eol >> bit) & 1)) {
+            if (st.colon < 0) {
+                st.colon = pos;
+            }
+            continue;
+        }
+        int r = end_of_line(st, buf, len, pos, spans, max, consumed);
+        if (r != SCAN_CONTINUE) {
+            return r;
+        }
+    }
+    return SCAN_CONTINUE;
+}
+
+// 逐字节扫描不足一个向量宽度的尾部
+static inline __attribute__((always_inline))
+int scan_tail(HeaderScanState& st, const char* buf, size_t len, size_t base,
+              HeaderSpan* spans, int max, size_t* consumed) {
+    for (size_t pos = base; pos < len; pos++) {
+        char c = buf[pos];
+        if (pos < st.line) {
+            continue;
+        }
+        if (c == ':') {
+            if (st.colon < 0) {
+                st.colon = pos;
+            }
+        } else if (c == '\r' || c == '\n') {
+            int r = end_of_line(st, buf, len, pos, spans, max, consumed);
+            if (r != SCAN_CONTINUE) {
+                return r;
+            }
+        }
+    }
+    return SCAN_INCOMPLETE;
+}
+
+// ---------------- 标量实现 ----------------
+
+static const char* find2_scalar(const char* p, const char* end, char a, char b) {
+    while (p < end && *p != a && *p != b) {
+        p++;
+    }
+    return p;
+}
+
+static const char* eol_scalar(const char* p, const char* end) {
+    return find2_scalar(p, end, '\r', '\n');
+}
+
+static const char* space_scalar(const char* p, const char* end) {
+    return find2_scalar(p, end, ' ', '\t');
+}
+
+// 逐行处理：先找行尾，再在行内用memchr找冒号
+static int headers_scalar(const char* buf, size_t len, HeaderSpan* spans, int max, size_t* consumed) {
+    HeaderScanState st = {0, -1, 0};
+    while (st.line < len) {
+        const char* eol = find2_scalar(buf + st.line, buf + len, '\r', '\n');
+        if (eol == buf + len) {
+            break;
+        }
+        const char* colon = (const char*)memchr(buf + st.line, ':', eol - (buf + st.line));
+        st.colon = colon ? colon - buf : -1;
+        int r = end_of_line(st, buf, len, eol - buf, spans, max, consumed);
+        if (r != SCAN_CONTINUE) {
+            return r;
+        }
+    }
+    return SCAN_INCOMPLETE;
+}
+
+#ifdef SCAN_X86
+// ---------------- SSE4.2：16字节/次 ----------------
+// PCMPESTRI/PCMPESTRM的EQUAL_ANY模式一条指令即可在16个字节中查找一组字符中的任意一个
+
+static const int SIDD_FIND_ANY = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT;
+
+__attribute__((target("sse4.2")))
+static const char* find2_sse42(const char* p, const char* end, char a, char b) {
+    const __m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int i = _mm_cmpestri(set, 2, v, 16, SIDD_FIND_ANY);
+        if (i < 16) {
+            return p + i;
+        }
+    }
+    return find2_scalar(p, end, a, b);
+}
+
+__attribute__((target("sse4.2")))
+static const char* eol_sse42(const char* p, const char* end) {
+    return find2_sse42(p, end, '\r', '\n');
+}
+
+__attribute__((target("sse4.2")))
+static const char* space_sse42(const char* p, const char* end) {
+    return find2_sse42(p, end, ' ', '\t');
+}
+
+__attribute__((target("sse4.2")))
+static int headers_sse42(const char* buf, size_t len, HeaderSpan* spans, int max, size_t* consumed) {
+    HeaderScanState st = {0, -1, 0};
+    const __m128i set = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i co = _mm_set1_epi8(':');
+    size_t base = 0;
+    for (; base + 16 <= len; base += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + base));
+        __m128i m = _mm_cmpestrm(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+        uint32_t eol = (uint32_t)_mm_cvtsi128_si32(m) & 0xFFFF;
+        uint32_t colon = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, co));
+        int r = consume_block(st, buf, len, base, eol, colon, spans, max, consumed);
+        if (r != SCAN_CONTINUE) {
+            return r;
+        }
+    }
+    return scan_tail(st, buf, len, base, spans, max, consumed);
+}
+
+// ---------------- AVX2：32字节/次 ----------------
+
+__attribute__((target("avx2")))
+static const char* find2_avx2(const char* p, const char* end, char a, char b) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (m) {
+            return p + __builtin_ctz(m);
+        }
+    }
+    return find2_scalar(p, end, a, b);
+}
+
+__attribute__((target("avx2")))
+static const char* eol_avx2(const char* p, const char* end) {
+    return find2_avx2(p, end, '\r', '\n');
+}
+
+__attribute__((target("avx2")))
+static const char* space_avx2(const char* p, const char* end) {
+    return find2_avx2(p, end, ' ', '\t');
+}
+
+__attribute__((target("avx2")))
+static int headers_avx2(const char* buf, size_t len, HeaderSpan* spans, int max, size_t* consumed) {
+    HeaderScanState st = {0, -1, 0};
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i co = _mm256_set1_epi8(':');
+    size_t base = 0;
+    for (; base + 32 <= len; base += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(buf + base));
+        uint32_t eol = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        uint32_t colon = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, co));
+        int r = consume_block(st, buf, len, base, eol, colon, spans, max, consumed);
+        if (r != SCAN_CONTINUE) {
+            return r;
+        }
+    }
+    return scan_tail(st, buf, len, base, spans, max, consumed);
+}
+#endif
+
+// ---------------- 运行时选择 ----------------
+
+struct ScanOps {
+    const char* name;
+    const char* (*eol)(const char*, const char*);
+    const char* (*space)(const char*, const char*);
+    int (*headers)(const char*, size_t, HeaderSpan*, int, size_t*);
+};
+
+static const ScanOps s_ops[] = {
+    { "scalar", eol_scalar, space_scalar, headers_scalar },
+#ifdef SCAN_X86
+    { "sse4.2", eol_sse42, space_sse42, headers_sse42 },
+    { "avx2", eol_avx2, space_avx2, headers_avx2 },
+#endif
+};
+
+static bool cpu_supports(ScanImpl impl) {
+    switch (impl) {
+        case SCAN_SCALAR:
+            return true;
+#ifdef SCAN_X86
+        case SCAN_SSE42:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.2");
+        case SCAN_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static const ScanOps* detect() {
+    if (cpu_supports(SCAN_AVX2)) {
+        return &s_ops[SCAN_AVX2];
+    }
+    if (cpu_supports(SCAN_SSE42)) {
+        return &s_ops[SCAN_SSE42];
+    }
+    return &s_ops[SCAN_SCALAR];
+}
+
+static const ScanOps* s_cur = detect();
+
+const char* scan_eol(const char* p, const char* end) {
+    return s_cur->eol(p, end);
+}
+
+const char* scan_space(const char* p, const char* end) {
+    return s_cur->space(p, end);
+}
+
+int scan_headers(const char* buf, size_t len, HeaderSpan* spans, int max, size_t* consumed) {
+    return s_cur->headers(buf, len, spans, max, consumed);
+}
+
+bool scan_select(ScanImpl impl) {
+    if (!cpu_supports(impl)) {
+        return false;
+    }
+    s_cur = &s_ops[impl];
+    return true;
+}
+
+const char* scan_impl_name() {
+    return s_cur->name;
+}
@@ -0,0 +1,216 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <new>
+
+Metrics metrics;
+
+__thread Metrics::Slot* Metrics::t_slot = NULL;
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+    for (int i = 0; i < HistogramLayout::BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max) {
+        max = other.max;
+    }
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    // 第rank个（从1开始）值所在的桶
+    uint64_t rank = (uint64_t)(q * count);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HistogramLayout::BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t upper = HistogramLayout::bucket_upper(i);
+            return upper < max ? upper : max;
+        }
+    }
+    return max;
+}
+
+Metrics::COUNTER Metrics::status_counter(int status) {
+    switch (status) {
+        case 200: return STATUS_200;
+        case 206: return STATUS_206;
+        case 304: return STATUS_304;
+        case 400: return STATUS_400;
+        case 403: return STATUS_403;
+        case 404: return STATUS_404;
+        case 416: return STATUS_416;
+        case 500: return STATUS_500;
+        case 503: return STATUS_503;
+        default: return STATUS_OTHER;
+    }
+}
+
+Metrics::Slot* Metrics::register_thread() {
+    void* mem = NULL;
+    if (posix_memalign(&mem, alignof(Slot), sizeof(Slot)) != 0) {
+        abort();
+    }
+    memset(mem, 0, sizeof(Slot));
+    Slot* slot = new (mem) Slot;
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    m_slots.push_back(slot);
+    // ------------- EXITING --------------
+    m_lock.unlock();
+    return slot;
+}
+
+void Metrics::snapshot(Snapshot* out) {
+    memset(out, 0, sizeof(*out));
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        const Slot* s = m_slots[i];
+        for (int c = 0; c < COUNTERS; c++) {
+            out->counters[c] += s->counters[c].load(std::memory_order_relaxed);
+        }
+        for (int p = 0; p < PHASES; p++) {
+            const Histogram& h = s->phases[p];
+            HistogramSnapshot& o = out->phases[p];
+            for (int b = 0; b < HistogramLayout::BUCKETS; b++) {
+                uint64_t n = h.counts[b].load(std::memory_order_relaxed);
+                o.counts[b] += n;
+                o.count += n;
+            }
+            o.sum += h.sum.load(std::memory_order_relaxed);
+            uint64_t max = h.max.load(std::memory_order_relaxed);
+            if (max > o.max) {
+                o.max = max;
+            }
+        }
+    }
+    // ------------- EXITING --------------
+    m_lock.unlock();
+}
+
+uint64_t Metrics::total(COUNTER c) {
+    uint64_t sum = 0;
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        sum += m_slots[i]->counters[c].load(std::memory_order_relaxed);
+    }
+    // ------------- EXITING --------------
+    m_lock.unlock();
+    return sum;
+}
+
+// 输出时使用的名字，与COUNTER/PHASE一一对应；状态码计数器单独输出
+static const char* const COUNTER_NAMES[Metrics::COUNTERS] = {
+    "accepts",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "bytes_sent", "queue_full", "epoll_ctl", "epoll_ctl_skipped",
+    "write_yields", "access_log_dropped",
+    "file_cache_hits", "file_cache_misses",
+    "content_cache_hits", "content_cache_misses"
+};
+static const char* const STATUS_NAMES[] = {
+    "200", "206", "304", "400", "403", "404", "416", "500", "503", "other"
+};
+static const char* const PHASE_NAMES[Metrics::PHASES] = {
+    "queue", "handle", "write", "total"
+};
+static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+static const char* const QUANTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+static const int QUANTILE_COUNT = sizeof(QUANTILES) / sizeof(QUANTILES[0]);
+
+// 依次追加格式化内容，空间不够时截断
+struct Writer {
+    char* buf;
+    size_t size;
+    size_t len;
+
+    void printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        if (len >= size) {
+            return;
+        }
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(buf + len, size - len, fmt, ap);
+        va_end(ap);
+        len = n < 0 ? len : (len + n < size ? len + n : size);
+    }
+};
+
+size_t Metrics::render_json(char* buf, size_t size) {
+    Snapshot* s = new Snapshot;
+    snapshot(s);
+    Writer w = {buf, size, 0};
+    w.printf("{\"counters\":{");
+    bool first = true;
+    for (int c = 0; c < COUNTERS; c++) {
+        if (COUNTER_NAMES[c]) {
+            w.printf("%s\"%s\":%llu", first ? "" : ",", COUNTER_NAMES[c], (unsigned long long)s->counters[c]);
+            first = false;
+        }
+    }
+    w.printf("},\"responses\":{");
+    for (int c = STATUS_200; c <= STATUS_OTHER; c++) {
+        w.printf("%s\"%s\":%llu", c == STATUS_200 ? "" : ",", STATUS_NAMES[c - STATUS_200],
+                 (unsigned long long)s->counters[c]);
+    }
+    // 平均每个响应的epoll_ctl次数（包括建立和关闭连接时的注册与注销）
+    uint64_t responses = 0;
+    for (int c = STATUS_200; c <= STATUS_OTHER; c++) {
+        responses += s->counters[c];
+    }
+    w.printf("},\"epoll_ctl_per_request\":%.3f", responses ? (double)s->counters[EPOLL_CTL] / responses : 0.0);
+    w.printf(",\"latency_ns\":{");
+    for (int p = 0; p < PHASES; p++) {
+        const HistogramSnapshot& h = s->phases[p];
+        w.printf("%s\"%s\":{\"count\":%llu,\"mean\":%llu", p == 0 ? "" : ",", PHASE_NAMES[p],
+                 (unsigned long long)h.count, (unsigned long long)(h.count ? h.sum / h.count : 0));
+        for (int q = 0; q < QUANTILE_COUNT; q++) {
+            w.printf(",\"%s\":%llu", QUANTILE_NAMES[q], (unsigned long long)h.quantile(QUANTILES[q]));
+        }
+        w.printf(",\"max\":%llu}", (unsigned long long)h.max);
+    }
+    w.printf("}}\n");
+    delete s;
+    return w.len;
+}
+
+size_t Metrics::render_prometheus(char* buf, size_t size) {
+    Snapshot* s = new Snapshot;
+    snapshot(s);
+    Writer w = {buf, size, 0};
+    for (int c = 0; c < COUNTERS; c++) {
+        if (COUNTER_NAMES[c]) {
+            w.printf("# TYPE webserver_%s_total counter\nwebserver_%s_total %llu\n",
+                     COUNTER_NAMES[c], COUNTER_NAMES[c], (unsigned long long)s->counters[c]);
+        }
+    }
+    w.printf("# TYPE webserver_responses_total counter\n");
+    for (int c = STATUS_200; c <= STATUS_OTHER; c++) {
+        w.printf("webserver_responses_total{code=\"%s\"} %llu\n", STATUS_NAMES[c - STATUS_200],
+                 (unsigned long long)s->counters[c]);
+    }
+    w.printf("# TYPE webserver_latency_seconds summary\n");
+    for (int p = 0; p < PHASES; p++) {
+        const HistogramSnapshot& h = s->phases[p];
+        for (int q = 0; q < QUANTILE_COUNT; q++) {
+            w.printf("webserver_latency_seconds{phase=\"%s\",quantile=\"%g\"} %.9f\n", PHASE_NAMES[p],
+                     QUANTILES[q], h.quantile(QUANTILES[q]) / 1e9);
+        }
+        w.printf("webserver_latency_seconds_sum{phase=\"%s\"} %.9f\n", PHASE_NAMES[p], h.sum / 1e9);
+        w.printf("webserver_latency_seconds_count{phase=\"%s\"} %llu\n", PHASE_NAMES[p],
+                 (unsigned long long)h.count);
+    }
+    delete s;
+    return w.len;
+}
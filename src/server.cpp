@@ -5,17 +5,30 @@
 #include <string.h>
 #include <cassert>
 #include <vector>
+#include <algorithm>
 #include <errno.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 
 #include <fcntl.h>
 #include <stdlib.h>
+#include <new>
 #include "thread_pool.h"
+#include "lockfree.h"
 #include "http_conn.h"
 #include "config.h"
+#include "file_cache.h"
+#include "content_cache.h"
+#include "buffer_pool.h"
+#include "timer_wheel.h"
+#include "uring_reactor.h"
+#include "metrics.h"
+#include "affinity.h"
+#include "access_log.h"
 
 // #define DEBUG_PRINT
 
@@ -34,18 +47,17 @@
 
 
 constexpr int MAX_FD = 65536;
-constexpr int MAX_EVENT_NUMBER = 1024;
 
 // constexpr int SUB_REACTORS = 1;
 // constexpr int WORKER_THREADS = 1;
 
 Config cfg;
 
-extern void addfd(int epollfd, int fd, bool oneshot, int trig_mode = 1);    // 自动non-block
+extern void addfd(int epollfd, int fd, bool oneshot, int trig_mode = 1);    // fd需已是non-block
 extern int removefd(int epollfd, int fd);
-extern int setnonblocking(int fd);
 
 int pipefd[2];  // 1写端0读端
+const char* config_path = NULL;     // -c指定的配置文件，SIGHUP时重新读取
 
 // signal handler
 void sig_handler(int sigid) {
@@ -71,13 +83,11 @@ void init_signal() {
     addsig(SIGPIPE, SIG_IGN);   // SIGPIPE忽略
     addsig(SIGINT, sig_handler);
     addsig(SIGTERM, sig_handler);
+    addsig(SIGHUP, sig_handler);
 
     // pipe(pipefd);   // 创建管道
-    int ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
+    int ret = socketpair(PF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pipefd);
     assert(ret != -1);
-    setnonblocking(pipefd[1]);
-
-
 }
 
 void show_error(int connfd, const char* info) {
@@ -86,27 +96,320 @@ void show_error(int connfd, const char* info) {
     close(connfd);
 }
 
+// 发送策略：accept得到的套接字继承监听套接字的这些选项，所以只需要设置在监听套接字上，不需要每个连接多一次系统调用
+void set_transmit_options(int listenfd, const Config& c) {
+    int nodelay = c.tcp_nodelay ? 1 : 0;
+    if (setsockopt(listenfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0) {
+        perror("setsockopt(TCP_NODELAY)");
+    }
+    // 0恢复为系统默认（net.ipv4.tcp_notsent_lowat）
+    int lowat = c.tcp_notsent_lowat > 0 ? c.tcp_notsent_lowat * 1024 : 0;
+    if (setsockopt(listenfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) < 0) {
+        perror("setsockopt(TCP_NOTSENT_LOWAT)");
+    }
+    if (c.send_buffer_size > 0) {
+        int sndbuf = c.send_buffer_size * 1024;
+        if (setsockopt(listenfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) < 0) {
+            perror("setsockopt(SO_SNDBUF)");
+        }
+    }
+}
+
+// 创建并绑定监听套接字，reuseport为true时设置SO_REUSEPORT，允许多个套接字绑定同一地址
+int create_listener(bool reuseport) {
+    int listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    assert(listenfd >= 0);
+
+    // SO_LINGER参数：设置套接字关闭时的行为
+    //  l_onoff int: 0表示执行正常的close操作，发送fin报文
+    //               1，分为l_linger==0和l_linger>0两种情况：
+    //                  l_linger==0，表示释放RST资源，发送RST报文，不经过TIME_WAIT状态
+    //                  l_linger==1，close()操作会进行阻塞，直到超时或所有缓冲区数据发送完，发送FIN并得到对方的ACK
+    //  l_linger int: 超时时间，单位秒
+    //               
+    struct linger tmp = {1, 0};
+    assert(setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp)) >= 0);
+
+    // SO_REUSEADDR参数：允许新的套接字立即绑定到相同的地址和端口，即使之前的套接字仍处于TIME_WAIT状态
+    int reuse = 1;
+    assert(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) >= 0);
+    if (reuseport) {
+        assert(setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) >= 0);
+    }
+    set_transmit_options(listenfd, cfg);
+
+    int ret = 0;
+    struct sockaddr_in address;
+    bzero(&address, sizeof(address));
+    address.sin_family = AF_INET;
+    inet_pton(AF_INET, cfg.listen_intf, &address.sin_addr);
+    address.sin_port = htons(cfg.listen_port);
+
+    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
+    if (ret < 0) {
+        perror("Unable to bind port");
+        close(listenfd);
+        return -1;
+    }
+
+    ret = listen(listenfd, cfg.listen_backlog);
+    assert(ret >= 0);
+    return listenfd;
+}
+
+// 为reuseport组挂载CBPF程序：返回值为组内套接字的下标（按bind顺序，即sub reactor的编号），
+// 按处理该连接SYN的CPU号查表，把连接交给绑定在这个CPU上的sub reactor；表由绑核计划生成，每个CPU一组比较+返回，
+// 不在表中的CPU取CPU号对组大小取模。每个sub reactor必须绑定到一个各不相同的CPU上，否则不挂载（由内核按哈希分配）
+bool attach_reuseport_cbpf(int listenfd, const std::vector<std::vector<int>>& reactor_cpus) {
+    std::vector<int> seen;
+    for (size_t i = 0; i < reactor_cpus.size(); i++) {
+        if (reactor_cpus[i].size() != 1 ||
+            std::find(seen.begin(), seen.end(), reactor_cpus[i][0]) != seen.end()) {
+            fprintf(stderr, "reuseport_cbpf requires each sub reactor to be pinned to a distinct cpu "
+                            "(sub_reactor_cpus), not attaching\n");
+            return false;
+        }
+        seen.push_back(reactor_cpus[i][0]);
+    }
+    std::vector<struct sock_filter> code;
+    code.push_back({ BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) });   // A = 当前CPU
+    for (size_t i = 0; i < reactor_cpus.size(); i++) {
+        code.push_back({ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, (uint32_t)reactor_cpus[i][0] });    // A == cpu ?
+        code.push_back({ BPF_RET | BPF_K, 0, 0, (uint32_t)i });                             //   return i
+    }
+    code.push_back({ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)reactor_cpus.size() });      // A %= group_size
+    code.push_back({ BPF_RET | BPF_A, 0, 0, 0 });                                           // return A
+    struct sock_fprog prog;
+    prog.len = code.size();
+    prog.filter = code.data();
+    if (setsockopt(listenfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0) {
+        perror("Unable to attach reuseport cbpf");
+        return false;
+    }
+    return true;
+}
+
+// 主反应堆接受、交给sub reactor的新连接
+struct Accepted {
+    int fd;
+    sockaddr_in addr;
+};
+
+// sub reactor的连接移交通道
+// 主反应堆是唯一的生产者、sub reactor是唯一的消费者，所以使用SPSC环形队列；主反应堆在一轮accept结束后
+// 对每个收到连接的reactor写一次eventfd，由sub reactor自己构造连接对象并注册到自己的epoll中，
+// 不会在其他线程中对它的epollfd调用epoll_ctl
+struct Handoff {
+    static const int RING_SIZE = 1024;
+    LockFreeQueue_SPSC<Accepted> ring;
+    event wakeup;
+    std::atomic_int users{0};   // 该reactor当前的连接数（由HTTPConn::init/close_conn维护）
+    bool signalled{false};      // 本轮accept是否已有连接入队（只由主反应堆访问）
+
+    Handoff() : ring(RING_SIZE) {}
+    // 负载：已建立的连接加上尚未取走的连接
+    int load() const {
+        return users.load(std::memory_order_relaxed) + (int)ring.size();
+    }
+};
+
+// 接受listenfd上的所有新连接（accept4直接得到非阻塞套接字）
+// self_epollfd不为-1时（reuseport模式，调用者就是该sub reactor）在本线程中直接建立连接，handoffs只含它自己的通道；
+// 否则（主反应堆）按负载（连接数+待取走的连接数）选择最轻的sub reactor，放入它的移交队列
+void accept_connections(int listenfd, HTTPConn* users, int self_epollfd, BufferPool* self_pool,
+                        TimerWheel* self_timers, HTTPConn::ReadyList* self_ready,
+                        const std::vector<Handoff*>& handoffs, int& rr_counter) {
+    bool local = self_epollfd != -1;
+    while (true) {
+        struct sockaddr_in cli_addr;
+        socklen_t cli_addr_len = sizeof(cli_addr);
+        int connfd = accept4(listenfd, (struct sockaddr*)&cli_addr, &cli_addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd < 0) {
+            if (errno == EAGAIN) {
+                break;  // All fds get!
+            }
+            perror("Error in accept()");
+            continue;
+        }
+        metrics.add(Metrics::ACCEPTS);
+        if (HTTPConn::m_user_count >= MAX_FD) {
+            show_error(connfd, "Internal server busy");
+            continue;
+        }
+        DPRINT("[%d]New connection incoming", connfd);
+        if (local) {
+            // 连接对象表只保留了地址空间，在这里构造对象
+            HTTPConn* conn = new (users + connfd) HTTPConn();
+            conn->init(connfd, self_epollfd, cli_addr, self_pool, self_timers, NULL, &handoffs[0]->users, self_ready);
+            continue;
+        }
+        // 从轮询位置开始找负载最轻的reactor，负载相同时依次轮换
+        int n = handoffs.size();
+        int target = -1;
+        int best = 0;
+        for (int k = 0; k < n; k++) {
+            int i = (rr_counter + k) % n;
+            int load = handoffs[i]->load();
+            if (!handoffs[i]->ring.full() && (target < 0 || load < best)) {
+                target = i;
+                best = load;
+            }
+        }
+        if (target < 0) {
+            show_error(connfd, "Internal server busy");
+            continue;
+        }
+        handoffs[target]->ring.push(Accepted{connfd, cli_addr});
+        handoffs[target]->signalled = true;
+        DPRINT("Dispatch connection fd = %d -> subreactor %d", connfd, target);
+        rr_counter = (target + 1) % n;
+    }
+    if (local) {
+        return;
+    }
+    for (size_t i = 0; i < handoffs.size(); i++) {
+        if (handoffs[i]->signalled) {
+            handoffs[i]->signalled = false;
+            handoffs[i]->wakeup.post();
+        }
+    }
+}
+
+// sub reactor取走主反应堆移交的连接，在本线程中构造并注册到自己的epoll
+static void take_connections(Handoff* handoff, HTTPConn* users, int epollfd, BufferPool* pool, TimerWheel* timers,
+                             HTTPConn::ReadyList* ready) {
+    // 先清零eventfd再取队列：之后入队的连接一定伴随一次新的post
+    handoff->wakeup.wait();
+    Accepted a;
+    while (handoff->ring.pop(a)) {
+        HTTPConn* conn = new (users + a.fd) HTTPConn();
+        conn->init(a.fd, epollfd, a.addr, pool, timers, NULL, &handoff->users, ready);
+    }
+}
+
 
 struct Context {
     ThreadPool<HTTPConn>* pool;
     HTTPConn* users;
     int epollfd;
     int listener;
+    int reactor_id;     // sub reactor编号，主反应堆为-1
     std::vector<int> sub_reactors_epollfd;
+    std::vector<BufferPool*> sub_reactors_pool;
+    std::vector<TimerWheel*> sub_reactors_timers;
+    std::vector<Handoff*> sub_reactors_handoff;         // 主反应堆向每个sub reactor移交连接的通道
+    std::vector<UringReactor*> sub_reactors_uring;     // use_io_uring时每个sub reactor的io_uring
+    std::vector<int> listeners;     // 所有监听套接字（重新加载配置时修改backlog）
+    std::vector<int> cpus;          // 本线程绑定的CPU，空表示不绑定
     // int sub_reactors_epollfd[SUB_REACTORS];
 };
 
+// 线程绑核计划：由配置中的CPU列表得到每个线程绑定的CPU，空列表表示不绑定
+struct AffinityPlan {
+    std::vector<int> main;
+    std::vector<std::vector<int>> reactors;
+    std::vector<std::vector<int>> workers;
+    std::vector<int> reactor_nodes;     // 每个sub reactor所在的NUMA节点，-1表示未绑定或无法确定
+};
+
+static bool plan_affinity(AffinityPlan& plan) {
+    std::vector<int> reactor_cpus, worker_cpus;
+    const char* bad = NULL;
+    if (!parse_cpu_list(cfg.main_reactor_cpus, plan.main)) {
+        bad = "main_reactor_cpus";
+    } else if (!parse_cpu_list(cfg.sub_reactor_cpus, reactor_cpus)) {
+        bad = "sub_reactor_cpus";
+    } else if (!parse_cpu_list(cfg.worker_cpus, worker_cpus)) {
+        bad = "worker_cpus";
+    }
+    if (bad) {
+        fprintf(stderr, "config: invalid cpu list for %s\n", bad);
+        return false;
+    }
+    plan.reactors.assign(cfg.sub_reactors, std::vector<int>());
+    plan.reactor_nodes.assign(cfg.sub_reactors, -1);
+    for (int i = 0; i < cfg.sub_reactors && !reactor_cpus.empty(); i++) {
+        int cpu = reactor_cpus[i % reactor_cpus.size()];
+        plan.reactors[i].push_back(cpu);
+        plan.reactor_nodes[i] = cpu_node(cpu);
+    }
+    plan.workers.assign(cfg.worker_threads, std::vector<int>());
+    for (int i = 0; i < cfg.worker_threads; i++) {
+        if (!worker_cpus.empty()) {
+            plan.workers[i].push_back(worker_cpus[i % worker_cpus.size()]);
+        } else if (cfg.colocate_workers && !reactor_cpus.empty()) {
+            // 工作线程由所有sub reactor共享，只能做到与其中一个reactor位于同一节点；
+            // 节点未知时退回与该reactor绑定在同一个CPU上
+            int r = i % cfg.sub_reactors;
+            if (plan.reactor_nodes[r] < 0 || !node_cpus(plan.reactor_nodes[r], plan.workers[i])) {
+                plan.workers[i] = plan.reactors[r];
+            }
+        }
+    }
+    return true;
+}
+
+// 把当前线程绑定到cpus上，reactor_id为-1表示主反应堆
+static void pin_self(const std::vector<int>& cpus, int reactor_id) {
+    if (cpus.empty()) {
+        return;
+    }
+    char who[32] = "main reactor";
+    if (reactor_id >= 0) {
+        snprintf(who, sizeof(who), "sub reactor %d", reactor_id);
+    }
+    if (pin_thread(pthread_self(), cpus)) {
+        printf("%s bound to cpus %s\n", who, format_cpu_list(cpus).c_str());
+    } else {
+        printf("%s: unable to bind to cpus %s\n", who, format_cpu_list(cpus).c_str());
+    }
+}
+
+// 每个事件循环在每轮开始时检查配置快照是否更新，需要时调整事件数组的大小
+static void refresh_events(const Config*& seen, std::vector<epoll_event>& events) {
+    const Config* cur = &live_cfg();
+    if (cur != seen) {
+        seen = cur;
+        events.resize(std::max(cur->max_events, 1));
+    }
+}
+
+// SIGHUP：重新读取配置文件并发布新快照，各线程在下一次读取配置时使用新值
+static void handle_reload(const Context& ctx) {
+    if (!config_path) {
+        printf("SIGHUP ignored: no config file (-c)\n");
+        return;
+    }
+    const Config* next = reload_config(config_path);
+    if (!next) {
+        printf("Config reload failed, keeping current settings\n");
+        return;
+    }
+    // 对正在监听的套接字再次调用listen()即可修改backlog，已排队的连接不受影响；发送策略只影响之后接受的连接
+    for (size_t i = 0; i < ctx.listeners.size(); i++) {
+        listen(ctx.listeners[i], next->listen_backlog);
+        set_transmit_options(ctx.listeners[i], *next);
+    }
+    // 访问日志被轮转（mv）后重新打开同名文件
+    access_log.reopen();
+    printf("Config reloaded from %s\n", config_path);
+}
+
 // main reactor
 // 主反应堆负责监听listenfd，并负责将接受的连接分发给sub reactor
+// reuseport模式下listenfd为-1，主反应堆只负责处理信号
 void* main_reactor([[maybe_unused]]void* arg) {
     Context ctx = *(Context*)arg;
     int epollfd = ctx.epollfd;
     int listenfd = ctx.listener;
     HTTPConn* users = ctx.users;
-    epoll_event events[MAX_EVENT_NUMBER];
+    const Config* seen_cfg = NULL;
+    std::vector<epoll_event> events;
     int rr_counter = 0; // round robin
+    pin_self(ctx.cpus, ctx.reactor_id);
     while (true) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
+        refresh_events(seen_cfg, events);
+        int number = epoll_wait(epollfd, events.data(), events.size(), -1);
         if ((number < 0) && (errno != EINTR)) {
             DPRINT("epoll failure");
             break;
@@ -114,27 +417,7 @@ void* main_reactor([[maybe_unused]]void* arg) {
         for (int i = 0; i < number; i++) {
             int sockfd = events[i].data.fd;
             if (sockfd == listenfd) {
-                while (true) {
-                    struct sockaddr_in cli_addr;
-                    socklen_t cli_addr_len = sizeof(cli_addr);
-                    int connfd = accept(listenfd, (struct sockaddr*)&cli_addr, &cli_addr_len);
-                    if (connfd < 0) {
-                        if (errno == EAGAIN) {
-                            break;  // All fds get!
-                        }
-                        perror("Error in accept()");
-                        continue;
-                    }
-                    if (HTTPConn::m_user_count >= MAX_FD) {
-                        show_error(connfd, "Internal server busy");
-                        continue;
-                    }
-                    DPRINT("[%d]New connection incoming", connfd);
-                    // users[connfd].init(connfd, sub_epollfd, cli_addr);
-                    users[connfd].init(connfd, ctx.sub_reactors_epollfd[rr_counter], cli_addr);
-                    DPRINT("Dispatch connection fd = %d -> subreactor epollfd = %d", connfd, ctx.sub_reactors_epollfd[rr_counter]);
-                    rr_counter = (rr_counter + 1) % cfg.sub_reactors;
-                }
+                accept_connections(listenfd, users, -1, NULL, NULL, NULL, ctx.sub_reactors_handoff, rr_counter);
             } else if ((sockfd == pipefd[0]) && (events[i].events & EPOLLIN)) {
                 while (true) {
                     DPRINT("signal process");
@@ -151,6 +434,9 @@ void* main_reactor([[maybe_unused]]void* arg) {
                                 printf("Quitting\n");
                                 // 清除工作
                                 return 0;
+                            case SIGHUP:
+                                handle_reload(ctx);
+                                break;
                             default:
                                 break;
                         }
@@ -164,24 +450,91 @@ void* main_reactor([[maybe_unused]]void* arg) {
     return 0;
 }
 
+// 处理已读入缓冲区的请求：run-to-completion模式下先尝试在本线程内完成，否则交给线程池
+static void dispatch_request(HTTPConn* conn, ThreadPool<HTTPConn>* pool) {
+    if (live_cfg().run_to_completion && conn->process_inline()) {
+        // 已在本线程内处理完毕
+        return;
+    }
+    conn->enter_worker();
+    if (!pool->append(conn)) {
+        // 队列已满
+        // 应该返回503
+        conn->leave_worker();
+        metrics.add(Metrics::QUEUE_FULL);
+        conn->write_respond(HTTPConn::SERVICE_UNAVAILABLE, true);
+        DPRINT("Queue is full");
+    }
+}
+
+// 连接可写（EPOLLOUT或从就绪列表中取出）：继续发送，发送完毕后处理读缓冲区中管线化的后续请求
+static void handle_writable(HTTPConn* conn, ThreadPool<HTTPConn>* pool) {
+    if (!conn->write()) {
+        DPRINT("Write done: closing connection");
+        conn->close_conn_write();
+    } else if (conn->has_pending_input()) {
+        // 管线化的后续请求已在读缓冲区中，不会再有EPOLLIN事件，直接继续处理
+        dispatch_request(conn, pool);
+    }
+}
+
+static void uring_dispatch(HTTPConn* conn, void* pool) {
+    dispatch_request(conn, (ThreadPool<HTTPConn>*)pool);
+}
+
 // sub reactor
 // 从反应堆监听从主反应堆中传入的fd，从反应堆的epollfd直接在参数中传入
+// reuseport模式下从反应堆还拥有自己的listener，直接接受连接并注册到自己的epollfd上
 void* sub_reactor(void* arg) {
     Context ctx = *(Context*)arg;
     int epollfd = ctx.epollfd;
+    int listenfd = ctx.listener;
     DPRINT("sub reactor's epollfd = %d", epollfd);
     HTTPConn* users = ctx.users;
     ThreadPool<HTTPConn>* pool = ctx.pool;
-    epoll_event events[MAX_EVENT_NUMBER];
+    const Config* seen_cfg = NULL;
+    std::vector<epoll_event> events;
+    BufferPool* buffers = ctx.sub_reactors_pool[ctx.reactor_id];
+    TimerWheel* timers = ctx.sub_reactors_timers[ctx.reactor_id];
+    Handoff* handoff = ctx.sub_reactors_handoff[ctx.reactor_id];
+    std::vector<Handoff*> self_handoff(1, handoff);
+    std::vector<TimerWheel::Node*> expired;
+    // 发送额度用完的连接，在下一次epoll_wait之前按加入顺序继续发送；running为正在处理的一批
+    HTTPConn::ReadyList ready, running;
+    int rr_counter = 0;
+    // 在分配本线程的任何数据之前绑核，使它们位于所在NUMA节点上
+    pin_self(ctx.cpus, ctx.reactor_id);
+    if (cfg.use_io_uring) {
+        // io_uring需要在提交它的线程中创建
+        UringReactor* uring = ctx.sub_reactors_uring[ctx.reactor_id];
+        if (uring->init(listenfd)) {
+            uring->run(uring_dispatch, pool);
+            return 0;
+        }
+        printf("sub reactor %d: io_uring unavailable, falling back to epoll\n", ctx.reactor_id);
+    }
+    if (listenfd != -1) {
+        addfd(epollfd, listenfd, false);
+    } else {
+        // 主反应堆移交的连接：每次事件只读一次eventfd，所以不需要非阻塞
+        addfd(epollfd, handoff->wakeup.fd(), false);
+    }
     while (true) {
-        int number = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
+        refresh_events(seen_cfg, events);
+        // 超时时间由时间轮决定，醒来后处理到期的连接；就绪列表不为空时只取已有的事件
+        int timeout = ready.empty() ? timers->next_timeout(TimerWheel::now_ms()) : 0;
+        int number = epoll_wait(epollfd, events.data(), events.size(), timeout);
         if ((number < 0) && (errno != EINTR)) {
             DPRINT("epoll failure");
             break;
         }
         for (int i = 0; i < number; i++) {
             int sockfd = events[i].data.fd;
-            if (events[i].events & (EPOLLRDHUP | EPOLLHUP)) {
+            if (sockfd == listenfd) {
+                accept_connections(listenfd, users, epollfd, buffers, timers, &ready, self_handoff, rr_counter);
+            } else if (sockfd == handoff->wakeup.fd()) {
+                take_connections(handoff, users, epollfd, buffers, timers, &ready);
+            } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP)) {
                 // RDHUP/HUP事件，为远方关闭连接
                 DPRINT("[%d.%d]RDHUP/HUP event, closing connection", epollfd, sockfd);
                 users[sockfd].close_conn();
@@ -189,116 +542,188 @@ void* sub_reactor(void* arg) {
                 // 异常时直接关闭客户连接
                 DPRINT("[%d.%d]Error: closing connection, event = %u", epollfd, sockfd, events[i].events);
                 users[sockfd].close_conn();
-            } else if (events[i].events & EPOLLIN) {
-                if (users[sockfd].read()) {
-                    if (!pool->append(users + sockfd)) {
-                        // 队列已满
-                        // 应该返回503
-                        users[sockfd].write_respond(HTTPConn::SERVICE_UNAVAILABLE, true);
-                        DPRINT("[%d.%d]Queue is full", epollfd, sockfd);
+            } else {
+                users[sockfd].on_event();
+                // 常驻注册下EPOLLIN与EPOLLOUT可能同时出现，也可能在响应还没发送完时收到EPOLLIN
+                if (events[i].events & EPOLLIN) {
+                    if (!users[sockfd].read()) {
+                        DPRINT("[%d.%d]Read error: closing connection", epollfd, sockfd);
+                        users[sockfd].close_conn();
+                        continue;
+                    }
+                    if (!users[sockfd].sending()) {
+                        dispatch_request(users + sockfd, pool);
+                        continue;
                     }
-                } else {
-                    DPRINT("[%d.%d]Read error: closing connection", epollfd, sockfd);
-                    users[sockfd].close_conn();
+                    // 数据留在读缓冲区中，响应发送完毕后再处理（见has_pending_input）
                 }
-            } else if (events[i].events & EPOLLOUT) {
-                // 写socket
-                if (!users[sockfd].write()) {
-                    DPRINT("[%d.%d]Write done: closing connection", epollfd, sockfd);
-                    // users[sockfd].close_conn();
-                    users[sockfd].close_conn_write();
+                if (!(events[i].events & EPOLLOUT)) {
+                    continue;
                 }
-            } else {
-                // do nothing
+                // 写socket
+                handle_writable(users + sockfd, pool);
+            }
+        }
+        // 本轮事件处理完毕后，让出的连接各自再发送一份额度，期间再次让出的连接排到下一轮
+        running.swap(ready);
+        for (size_t i = 0; i < running.size(); i++) {
+            if (running[i]->take_ready()) {
+                handle_writable(running[i], pool);
             }
         }
+        running.clear();
+        timers->expire(TimerWheel::now_ms(), HTTPConn::timer_check, expired);
+        for (size_t i = 0; i < expired.size(); i++) {
+            ((HTTPConn*)expired[i]->owner)->expire_timeout();
+        }
+        expired.clear();
     }
     return 0;
 }
 
 int main(int argc, char* argv[]) {
     cfg.init_default();
-    cfg.print();
     // Cmd parse
-    if (argc == 1) {
+    // 配置文件先于其余参数读取，命令行中的地址和端口优先
+    int argi = 1;
+    if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+        config_path = argv[2];
+        if (!cfg.load_from(config_path)) {
+            return -1;
+        }
+        argi = 3;
+    }
+    if (argc - argi == 0) {
         // default listen on 0.0.0.0:1234
-    } else if (argc == 2) {
-        cfg.listen_port = atoi(argv[1]);
-    } else if (argc == 3) {
-        strncpy(cfg.listen_intf, argv[1], 80);
-        cfg.listen_port = atoi(argv[2]);
+    } else if (argc - argi == 1) {
+        cfg.listen_port = atoi(argv[argi]);
+    } else if (argc - argi == 2) {
+        strncpy(cfg.listen_intf, argv[argi], sizeof(cfg.listen_intf) - 1);
+        cfg.listen_port = atoi(argv[argi + 1]);
     } else {
-        printf("usage:\t%s [port]\n\t%s local_ip port\n", argv[0], argv[0]);
+        printf("usage:\t%s [-c config] [port]\n\t%s [-c config] local_ip port\n", argv[0], argv[0]);
+        return -1;
+    }
+    cfg.print();
+
+    AffinityPlan plan;
+    if (!plan_affinity(plan)) {
         return -1;
     }
 
     // 初始化信号处理
     init_signal();
+
+    // 打开文件缓存初始化
+    file_cache.init(cfg.doc_root, cfg.use_file_cache, cfg.file_cache_shards,
+                    cfg.file_cache_entries, cfg.file_cache_ttl);
+    content_cache.init(cfg.use_content_cache, cfg.file_cache_shards,
+                       cfg.content_cache_max_file, (size_t)cfg.content_cache_size * 1024);
+    // 访问日志：后台线程写入，请求路径上只入队
+    if (cfg.access_log[0] != '\0' && !access_log.open(cfg.access_log, cfg.access_log_binary, cfg.access_log_ring)) {
+        return -1;
+    }
     
     // Context上下文类型创建
     Context ctx;
     
     // 线程池创建
     try {
-        ctx.pool = new ThreadPool<HTTPConn>(cfg.worker_threads);
+        ctx.pool = new ThreadPool<HTTPConn>(cfg.worker_threads, cfg.max_requests);
     } catch (...) {
         DPRINT("Unable to init thread pool.");
         exit(-1);
     }
+    for (int i = 0; i < cfg.worker_threads; i++) {
+        if (plan.workers[i].empty()) {
+            continue;
+        }
+        const char* fmt = pin_thread(ctx.pool->thread(i), plan.workers[i]) ?
+            "worker %d bound to cpus %s\n" : "worker %d: unable to bind to cpus %s\n";
+        printf(fmt, i, format_cpu_list(plan.workers[i]).c_str());
+    }
 
-    // 为每个可能的客户都预先分配一个HTTPConn对象
-    // HTTPConn* users = new HTTPConn[MAX_FD];
-    ctx.users = new HTTPConn[MAX_FD];
+    // 为每个可能的客户都预留一个HTTPConn对象的位置
+    // 只保留地址空间，不在启动时触碰整个数组；读写缓冲区在请求处理期间才从各reactor的内存池中借用
+    ctx.users = HTTPConn::create_table(MAX_FD);
     assert(ctx.users);
+    // 连接表按fd索引，同一页上的连接可能属于不同的reactor，只能整体放置：所有sub reactor位于同一节点时放在该节点上
+    int table_node = plan.reactor_nodes.empty() ? -1 : plan.reactor_nodes[0];
+    for (int i = 1; i < cfg.sub_reactors; i++) {
+        if (plan.reactor_nodes[i] != table_node) {
+            table_node = -1;
+        }
+    }
+    if (table_node >= 0) {
+        prefer_node(ctx.users, sizeof(HTTPConn) * MAX_FD, table_node);
+    }
     // int user_count = 0;
 
     // listener初始化
-    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(listenfd >= 0);
-
-    // SO_LINGER参数：设置套接字关闭时的行为
-    //  l_onoff int: 0表示执行正常的close操作，发送fin报文
-    //               1，分为l_linger==0和l_linger>0两种情况：
-    //                  l_linger==0，表示释放RST资源，发送RST报文，不经过TIME_WAIT状态
-    //                  l_linger==1，close()操作会进行阻塞，直到超时或所有缓冲区数据发送完，发送FIN并得到对方的ACK
-    //  l_linger int: 超时时间，单位秒
-    //               
-    struct linger tmp = {1, 0};
-    assert(setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp)) >= 0);
-
-    // SO_REUSEADDR参数：允许新的套接字立即绑定到相同的地址和端口，即使之前的套接字仍处于TIME_WAIT状态
-    int reuse = 1;
-    assert(setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) >= 0);
-
-    int ret = 0;
-    struct sockaddr_in address;
-    bzero(&address, sizeof(address));
-    address.sin_family = AF_INET;
-    inet_pton(AF_INET, cfg.listen_intf, &address.sin_addr);
-    address.sin_port = htons(cfg.listen_port);
-
-    ret = bind(listenfd, (struct sockaddr*)&address, sizeof(address));
-    if (ret < 0) {
-        perror("Unable to bind port");
-        close(listenfd);
-        return -1;
+    // reuseport模式下每个sub reactor各自拥有一个listener，由内核在它们之间分配新连接
+    std::vector<int> sub_listenfds(cfg.sub_reactors, -1);
+    int listenfd = -1;
+    // io_uring的reactor不与主反应堆共享监听套接字，同样使用reuseport
+    if (cfg.reuseport || cfg.use_io_uring) {
+        for (int i = 0; i < cfg.sub_reactors; i++) {
+            sub_listenfds[i] = create_listener(true);
+            if (sub_listenfds[i] < 0) {
+                return -1;
+            }
+        }
+        if (cfg.reuseport_cbpf) {
+            attach_reuseport_cbpf(sub_listenfds[0], plan.reactors);
+        }
+    } else {
+        listenfd = create_listener(false);
+        if (listenfd < 0) {
+            return -1;
+        }
     }
-
-    ret = listen(listenfd, 100);
-    assert(ret >= 0);
-    
     ctx.listener = listenfd;
+    for (int i = 0; i < cfg.sub_reactors; i++) {
+        if (sub_listenfds[i] != -1) {
+            ctx.listeners.push_back(sub_listenfds[i]);
+        }
+    }
+    if (listenfd != -1) {
+        ctx.listeners.push_back(listenfd);
+    }
 
     // sub reactors初始化
     std::vector<int> sub_epollfds(cfg.sub_reactors, -1);
     std::vector<pthread_t> sub_reactor_threads(cfg.sub_reactors);
     std::vector<Context> sub_ctx(cfg.sub_reactors);
+    ctx.reactor_id = -1;
+    ctx.sub_reactors_pool.resize(cfg.sub_reactors);
+    ctx.sub_reactors_timers.resize(cfg.sub_reactors);
+    ctx.sub_reactors_handoff.resize(cfg.sub_reactors);
+    ctx.sub_reactors_uring.resize(cfg.sub_reactors, NULL);
+    // 各reactor的数据结构在构造时就会被写入：构造期间主线程临时绑定到该reactor的CPU上，使页分配在它所在的节点
+    cpu_set_t main_cpus;
+    pthread_getaffinity_np(pthread_self(), sizeof(main_cpus), &main_cpus);
+    for (int i = 0; i < cfg.sub_reactors; i++) {
+        if (!plan.reactors[i].empty()) {
+            pin_thread(pthread_self(), plan.reactors[i]);
+        }
+        ctx.sub_reactors_pool[i] = new BufferPool();
+        ctx.sub_reactors_pool[i]->set_node(plan.reactor_nodes[i]);
+        ctx.sub_reactors_timers[i] = new TimerWheel();
+        ctx.sub_reactors_handoff[i] = new Handoff();
+        if (cfg.use_io_uring) {
+            ctx.sub_reactors_uring[i] = new UringReactor(ctx.users, MAX_FD, ctx.sub_reactors_pool[i],
+                                                         ctx.sub_reactors_timers[i]);
+        }
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(main_cpus), &main_cpus);
     for (int i = 0; i < cfg.sub_reactors; i++) {
         sub_epollfds[i] = epoll_create(65535);  // size parameter is unused!
         // sub reactor上下文初始化
         sub_ctx[i] = ctx;
         sub_ctx[i].epollfd = sub_epollfds[i];
-        sub_ctx[i].listener = -1;
+        sub_ctx[i].listener = sub_listenfds[i];
+        sub_ctx[i].reactor_id = i;
+        sub_ctx[i].cpus = plan.reactors[i];
         int ret = pthread_create(&sub_reactor_threads[i], NULL, sub_reactor, &sub_ctx[i]);
         if (ret != 0) {
             // error when create thread
@@ -313,21 +738,54 @@ int main(int argc, char* argv[]) {
     // 主线程epollfd创建
     int epollfd = epoll_create(65535);
     assert(epollfd != -1);
-    addfd(epollfd, listenfd, false);
+    if (listenfd != -1) {
+        addfd(epollfd, listenfd, false);
+    }
     addfd(epollfd, pipefd[0], false);
     ctx.epollfd = epollfd;
     ctx.sub_reactors_epollfd = sub_epollfds;
+    ctx.cpus = plan.main;
 
     main_reactor(&ctx);
 
     DPRINT("Cleanup");
+    // 先写出队列中剩余的访问日志
+    access_log.close();
+    FileCache::Stats fc_stats = file_cache.stats();
+    printf("file cache: hits = %lu, misses = %lu, evictions = %lu\n",
+           (unsigned long)fc_stats.hits, (unsigned long)fc_stats.misses, (unsigned long)fc_stats.evictions);
+    ContentCache::Stats cc_stats = content_cache.stats();
+    printf("content cache: hits = %lu, misses = %lu, evictions = %lu, bytes = %lu\n",
+           (unsigned long)cc_stats.hits, (unsigned long)cc_stats.misses,
+           (unsigned long)cc_stats.evictions, (unsigned long)cc_stats.bytes);
+    for (int i = 0; i < cfg.sub_reactors; i++) {
+        BufferPool::Stats bp_stats = ctx.sub_reactors_pool[i]->stats();
+        printf("buffer pool %d: slab bytes = %lu, in use bytes = %lu\n", i,
+               (unsigned long)bp_stats.slab_bytes, (unsigned long)bp_stats.in_use_bytes);
+    }
+    for (int i = 0; i < cfg.sub_reactors; i++) {
+        if (ctx.sub_reactors_uring[i]) {
+            UringReactor::Stats us = ctx.sub_reactors_uring[i]->stats();
+            printf("io_uring %d: enters = %lu, sqes = %lu, cqes = %lu\n", i,
+                   (unsigned long)us.enters, (unsigned long)us.sqes, (unsigned long)us.cqes);
+        }
+    }
+    printf("timeouts: header = %lu, keepalive = %lu, write = %lu\n",
+           (unsigned long)HTTPConn::m_timeouts[HTTPConn::TIMEOUT_HEADER].load(),
+           (unsigned long)HTTPConn::m_timeouts[HTTPConn::TIMEOUT_IDLE].load(),
+           (unsigned long)HTTPConn::m_timeouts[HTTPConn::TIMEOUT_WRITE].load());
     // Cleanup
     for (int i = 0; i < cfg.sub_reactors; i++) {
         close(sub_epollfds[i]);
+        if (sub_listenfds[i] != -1) {
+            close(sub_listenfds[i]);
+        }
     }
     close(epollfd);
-    close(listenfd);
-    delete[] ctx.users;
+    if (listenfd != -1) {
+        close(listenfd);
+    }
+    HTTPConn::destroy_table(ctx.users, MAX_FD);
     delete ctx.pool;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel() : m_current_tick(now_ms() / TICK_MS), m_size(0) {
+    for (int i = 0; i < SLOTS; i++) {
+        m_slots[i].prev = m_slots[i].next = &m_slots[i];
+    }
+}
+
+// 调用时已持有锁
+void TimerWheel::link(Node* node) {
+    // 向上取整：处理第tick个槽时（now >= tick * TICK_MS），槽中本圈的节点一定已经到期
+    int64_t tick = (node->expire_ms + TICK_MS - 1) / TICK_MS;
+    if (tick <= m_current_tick) {
+        // 对应的槽已经处理过，放到下一个tick
+        tick = m_current_tick + 1;
+    }
+    Node* head = &m_slots[tick & (SLOTS - 1)];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    m_size++;
+}
+
+// 调用时已持有锁
+void TimerWheel::unlink(Node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+    m_size--;
+}
+
+void TimerWheel::arm(Node* node, int64_t expire_ms) {
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    if (node->next) {
+        unlink(node);
+    }
+    node->expire_ms = expire_ms;
+    link(node);
+    // ------------- EXITING --------------
+    m_lock.unlock();
+}
+
+void TimerWheel::cancel(Node* node) {
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    if (node->next) {
+        unlink(node);
+    }
+    // ------------- EXITING --------------
+    m_lock.unlock();
+}
+
+void TimerWheel::expire(int64_t now, Check check, std::vector<Node*>& out) {
+    int64_t now_tick = now / TICK_MS;
+    m_lock.lock();
+    // ------------- CRITICAL AREA --------
+    // 长时间没有处理时，每个槽最多只需要遍历一次
+    int64_t first = now_tick - m_current_tick > SLOTS ? now_tick - SLOTS + 1 : m_current_tick + 1;
+    for (int64_t tick = first; tick <= now_tick; tick++) {
+        Node* head = &m_slots[tick & (SLOTS - 1)];
+        for (Node* node = head->next; node != head;) {
+            Node* next = node->next;
+            if (node->expire_ms <= now) {
+                unlink(node);
+                int64_t again = -1;
+                if (check(node, now, &again)) {
+                    out.push_back(node);
+                } else if (again >= 0) {
+                    // 先记下来，不能在遍历过程中插回可能正在遍历的槽
+                    node->expire_ms = again;
+                    m_later.push_back(node);
+                }
+            }
+            node = next;
+        }
+    }
+    m_current_tick = now_tick;
+    for (size_t i = 0; i < m_later.size(); i++) {
+        link(m_later[i]);
+    }
+    m_later.clear();
+    // ------------- EXITING --------------
+    m_lock.unlock();
+}
+
+int TimerWheel::next_timeout(int64_t now) {
+    m_lock.lock();
+    size_t size = m_size;
+    m_lock.unlock();
+    if (size == 0) {
+        return IDLE_POLL_MS;
+    }
+    int64_t wait = (m_current_tick + 1) * TICK_MS - now;
+    return wait > 0 ? (int)wait : 0;
+}
@@ -0,0 +1,733 @@
+#include "uring_reactor.h"
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "http_conn.h"
+
+// #define DEBUG_PRINT
+
+#ifdef DEBUG_PRINT
+#define DPRINT(fmt, ...) \
+    do {\
+    printf("%s:%d %s()>" fmt "\n", \
+    (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__), \
+    __LINE__, \
+    __func__, \
+    ##__VA_ARGS__); \
+    } while (0)
+#else
+#define DPRINT(fmt, ...) ((void)0)
+#endif
+
+// 当前线程运行的reactor，用于区分rearm是否来自reactor线程自身
+static __thread UringReactor* t_current = NULL;
+
+static inline uint64_t make_user_data(int op, int fd) {
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+// SendReq占用的内存池块大小
+static size_t send_req_block(size_t size) {
+    size_t block = BufferPool::min_size();
+    while (block < size) {
+        block <<= 1;
+    }
+    return block;
+}
+
+UringReactor::UringReactor(HTTPConn* users, int max_fd, BufferPool* pool, TimerWheel* timers)
+    : m_users(users), m_max_fd(max_fd), m_pool(pool), m_timers(timers), m_remote(max_fd) {
+}
+
+UringReactor::~UringReactor() {
+    if (m_slots) {
+        munmap(m_slots, sizeof(Slot) * m_max_fd);
+    }
+    if (m_bufs) {
+        munmap(m_bufs, (size_t)BUF_COUNT * BUF_SIZE);
+    }
+    if (m_br) {
+        munmap(m_br, m_br_size);
+    }
+    if (m_sqes) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_sq_ptr) {
+        munmap(m_sq_ptr, m_sq_size);
+    }
+    if (m_ring_fd != -1) {
+        ::close(m_ring_fd);
+    }
+}
+
+bool UringReactor::setup_ring() {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    // 只有reactor线程提交和收割，完成事件推迟到io_uring_enter时处理，减少对reactor线程的打断
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+              IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    p.cq_entries = CQ_ENTRIES;
+    m_ring_fd = syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+    if (m_ring_fd < 0 && errno == EINVAL) {
+        // 较老的内核不支持上面的部分标志
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = CQ_ENTRIES;
+        m_ring_fd = syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+    }
+    if (m_ring_fd < 0) {
+        perror("io_uring_setup");
+        return false;
+    }
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG |
+                              IORING_FEAT_CQE_SKIP | IORING_FEAT_LINKED_FILE;
+    if ((p.features & required) != required) {
+        return false;
+    }
+
+    // SQ和CQ共用一次mmap
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_sq_size = sq_size > cq_size ? sq_size : cq_size;
+    void* ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     m_ring_fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    m_sq_ptr = ptr;
+    m_cq_ptr = ptr;
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ptr = mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               m_ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe*)ptr;
+
+    char* sq = (char*)m_sq_ptr;
+    m_sq_khead = (unsigned*)(sq + p.sq_off.head);
+    m_sq_ktail = (unsigned*)(sq + p.sq_off.tail);
+    m_sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    m_sq_entries = *(unsigned*)(sq + p.sq_off.ring_entries);
+    // SQE按顺序使用，索引数组固定为恒等映射
+    unsigned* array = (unsigned*)(sq + p.sq_off.array);
+    for (unsigned i = 0; i < m_sq_entries; i++) {
+        array[i] = i;
+    }
+    m_sq_tail = *m_sq_ktail;
+    m_sq_submitted = m_sq_tail;
+
+    char* cq = (char*)m_cq_ptr;
+    m_cq_khead = (unsigned*)(cq + p.cq_off.head);
+    m_cq_ktail = (unsigned*)(cq + p.cq_off.tail);
+    m_cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+}
+
+bool UringReactor::setup_buffers() {
+    m_br_size = BUF_COUNT * sizeof(struct io_uring_buf);
+    void* ptr = mmap(NULL, m_br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    m_br = (struct io_uring_buf*)ptr;
+    ptr = mmap(NULL, (size_t)BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    m_bufs = (char*)ptr;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)m_br;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("io_uring_register(PBUF_RING)");
+        return false;
+    }
+    for (unsigned bid = 0; bid < BUF_COUNT; bid++) {
+        recycle(bid);
+    }
+    publish_buffers();
+    return true;
+}
+
+// 注册稀疏的固定文件表，下标即fd；表的大小受RLIMIT_NOFILE限制，失败时所有操作使用普通fd
+void UringReactor::setup_files() {
+    struct rlimit rl;
+    int n = m_max_fd;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t)n) {
+        n = (int)rl.rlim_cur;
+    }
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = n;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) < 0) {
+        perror("io_uring_register(FILES2)");
+        m_files = 0;
+        return;
+    }
+    m_files = n;
+    if (fixed(m_listenfd)) {
+        int fd = m_listenfd;
+        struct io_uring_files_update upd;
+        memset(&upd, 0, sizeof(upd));
+        upd.offset = fd;
+        upd.fds = (uint64_t)(uintptr_t)&fd;
+        m_listen_fixed = syscall(__NR_io_uring_register, m_ring_fd, IORING_REGISTER_FILES_UPDATE, &upd, 1) == 1;
+    }
+}
+
+bool UringReactor::init(int listenfd) {
+    m_listenfd = listenfd;
+    void* ptr = mmap(NULL, sizeof(Slot) * m_max_fd, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+    m_slots = (Slot*)ptr;
+    if (!setup_ring() || !setup_buffers()) {
+        return false;
+    }
+    setup_files();
+    return true;
+}
+
+struct io_uring_sqe* UringReactor::get_sqe() {
+    while (m_sq_tail - __atomic_load_n(m_sq_khead, __ATOMIC_ACQUIRE) >= m_sq_entries) {
+        // SQ已满，先提交已有的SQE
+        enter(0, 0, 0);
+    }
+    struct io_uring_sqe* sqe = &m_sqes[m_sq_tail & m_sq_mask];
+    m_sq_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// 发布本地的SQ尾指针，提交所有未提交的SQE并等待至少min_complete个完成事件（最多timeout_ms毫秒）
+int UringReactor::enter(unsigned to_submit, unsigned min_complete, int timeout_ms) {
+    __atomic_store_n(m_sq_ktail, m_sq_tail, __ATOMIC_RELEASE);
+    to_submit += m_sq_tail - m_sq_submitted;
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uint64_t)(uintptr_t)&ts;
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    int ret = syscall(__NR_io_uring_enter, m_ring_fd, to_submit, min_complete, flags, &arg, sizeof(arg));
+    m_enters.fetch_add(1, std::memory_order_relaxed);
+    if (ret > 0) {
+        m_sq_submitted += ret;
+        m_sqe_count.fetch_add(ret, std::memory_order_relaxed);
+    } else if (ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+        perror("io_uring_enter");
+    }
+    return ret;
+}
+
+void UringReactor::arm_accept() {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->flags = m_listen_fixed ? IOSQE_FIXED_FILE : 0;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(OP_ACCEPT, m_listenfd);
+}
+
+void UringReactor::arm_event() {
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_wakeup_event.fd();
+    sqe->addr = (uint64_t)(uintptr_t)&m_event_val;
+    sqe->len = sizeof(m_event_val);
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = make_user_data(OP_EVENT, 0);
+}
+
+void UringReactor::arm_recv(int fd) {
+    Slot& s = m_slots[fd];
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT | (fixed(fd) ? IOSQE_FIXED_FILE : 0);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = make_user_data(OP_RECV, fd);
+    s.recv_armed = true;
+    s.inflight++;
+}
+
+// 只取消multishot recv（按user_data匹配），完成时产生-ECANCELED的CQE；已收到的数据仍然按顺序到达
+void UringReactor::pause_recv(int fd) {
+    Slot& s = m_slots[fd];
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = make_user_data(OP_RECV, fd);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = make_user_data(OP_IGNORE, fd);
+    s.recv_paused = true;
+}
+
+// 整批响应用一次sendmsg发送；最后一个响应要求关闭连接时，链接一个shutdown(SHUT_WR)，不需要等发送完成再提交
+void UringReactor::submit_send(int fd) {
+    Slot& s = m_slots[fd];
+    HTTPConn& conn = m_users[fd];
+    size_t block = send_req_block(sizeof(SendReq));
+    SendReq* req = (SendReq*)m_pool->alloc(block);
+    if (!req) {
+        close_conn(fd);
+        return;
+    }
+    bool close_after = false;
+    int n = conn.send_iov(req->iov, MAX_SEND_IOV, &close_after);
+    if (n == 0) {
+        // 没有待发送的数据
+        m_pool->free((char*)req, block);
+        s.state = SLOT_BUSY;
+        conn.send_done(0);
+        return;
+    }
+    memset(&req->msg, 0, sizeof(req->msg));
+    req->msg.msg_iov = req->iov;
+    req->msg.msg_iovlen = n;
+
+    unsigned file_flag = fixed(fd) ? IOSQE_FIXED_FILE : 0;
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->flags = file_flag | (close_after ? IOSQE_IO_LINK : 0);
+    sqe->addr = (uint64_t)(uintptr_t)&req->msg;
+    sqe->len = 1;
+    // 套接字缓冲区满时由内核等待可写并继续发送，完成时要么全部发出，要么出错
+    sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+    sqe->user_data = make_user_data(OP_SEND, fd);
+    s.send = req;
+    s.inflight++;
+    s.state = SLOT_SENDING;
+    s.shutdown_linked = close_after;
+    if (close_after) {
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_SHUTDOWN;
+        sqe->fd = fd;
+        sqe->flags = file_flag | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->len = SHUT_WR;
+        sqe->user_data = make_user_data(OP_IGNORE, fd);
+    }
+}
+
+// 把接收缓冲区还给内核，publish_buffers之后才对内核可见
+void UringReactor::recycle(int bid) {
+    struct io_uring_buf* buf = &m_br[m_br_tail & (BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(m_bufs + (size_t)bid * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = bid;
+    m_br_tail++;
+    m_free_bufs++;
+}
+
+// ring的尾指针与第一个元素的resv字段重叠（见struct io_uring_buf_ring）；
+// 这里不直接使用io_uring_buf_ring：其中的柔性数组在C++中会因为空结构体占1字节而偏移
+void UringReactor::publish_buffers() {
+    __atomic_store_n(&m_br[0].resv, m_br_tail, __ATOMIC_RELEASE);
+}
+
+void UringReactor::rearm(int fd, int ev) {
+    Rearm r = { fd, ev, m_slots[fd].gen };
+    if (t_current == this) {
+        // 本轮循环结束前处理
+        m_local.push_back(r);
+        return;
+    }
+    // 每个连接同一时间最多有一个未处理的rearm，队列容量为max_fd，不会长时间处于满的状态
+    while (!m_remote.push(r)) {
+        sched_yield();
+    }
+    // 只有reactor没有被通知过时才写eventfd
+    if (!m_wakeup.exchange(true)) {
+        m_wakeup_event.post();
+    }
+}
+
+bool UringReactor::detach(int fd) {
+    Slot& s = m_slots[fd];
+    if (s.inflight == 0) {
+        return true;
+    }
+    if (s.state != SLOT_CLOSING) {
+        s.state = SLOT_CLOSING;
+        struct io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL |
+                            (fixed(fd) ? IORING_ASYNC_CANCEL_FD_FIXED : 0);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = make_user_data(OP_IGNORE, fd);
+    }
+    return false;
+}
+
+// 连接资源已释放。先清除固定文件表中的引用再关闭fd（两者都在下一次io_uring_enter时执行）：
+// 只有两个引用都释放后套接字才真正关闭；close执行之前fd不会被accept重新分配，所以不会与新连接的FILES_UPDATE乱序
+void UringReactor::close_fd(int fd) {
+    Slot& s = m_slots[fd];
+    for (int b = s.head; b != 0;) {
+        int bid = b - 1;
+        b = m_buf_next[bid];
+        recycle(bid);
+    }
+    s.head = s.tail = 0;
+    s.held = 0;
+    s.state = SLOT_FREE;
+    s.gen++;
+    s.eof = false;
+    s.shutdown_linked = false;
+    if (fixed(fd)) {
+        s.fd_value = -1;
+        struct io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)&s.fd_value;
+        sqe->len = 1;
+        sqe->off = fd;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = make_user_data(OP_IGNORE, fd);
+    }
+    struct io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = make_user_data(OP_IGNORE, fd);
+}
+
+void UringReactor::close_conn(int fd) {
+    m_users[fd].close_conn();
+}
+
+void UringReactor::maybe_finish_close(int fd) {
+    Slot& s = m_slots[fd];
+    if (s.state == SLOT_CLOSING && s.inflight == 0) {
+        m_users[fd].close_conn();
+    }
+}
+
+void UringReactor::on_cqe(const struct io_uring_cqe* cqe) {
+    int op = (int)(cqe->user_data >> 32);
+    int fd = (int)(uint32_t)cqe->user_data;
+    switch (op) {
+        case OP_ACCEPT:
+            on_accept(cqe->res, cqe->flags);
+            break;
+        case OP_RECV:
+            on_recv(fd, cqe->res, cqe->flags);
+            break;
+        case OP_SEND:
+            on_send(fd, cqe->res);
+            break;
+        case OP_EVENT:
+            // 先清除标志再处理队列（见rearm）
+            m_wakeup.store(false);
+            arm_event();
+            break;
+        default:
+            // 取消、关闭等操作失败时才会产生CQE，连接已经在关闭流程中
+            DPRINT("[%d]Ignored cqe, res = %d", fd, cqe->res);
+            break;
+    }
+}
+
+void UringReactor::on_accept(int res, uint32_t flags) {
+    if (!(flags & IORING_CQE_F_MORE)) {
+        // multishot accept已经停止（出错或被取消），重新提交
+        arm_accept();
+    }
+    if (res < 0) {
+        DPRINT("accept failed: %s", strerror(-res));
+        return;
+    }
+    int fd = res;
+    metrics.add(Metrics::ACCEPTS);
+    if (fd >= m_max_fd || HTTPConn::m_user_count >= m_max_fd) {
+        ::close(fd);
+        return;
+    }
+    Slot& s = m_slots[fd];
+    uint32_t gen = s.gen;
+    memset(&s, 0, sizeof(s));
+    s.gen = gen;
+    s.state = SLOT_READING;
+    // multishot accept的所有完成事件共用提交时给出的地址缓冲区，无法区分各连接的地址，这里单独查询（访问日志需要）
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(fd, (struct sockaddr*)&addr, &addr_len) < 0) {
+        memset(&addr, 0, sizeof(addr));
+    }
+    HTTPConn* conn = new (m_users + fd) HTTPConn();
+    conn->init(fd, -1, addr, m_pool, m_timers, this);
+    DPRINT("[%d]New connection incoming", fd);
+    if (fixed(fd)) {
+        // 注册为固定文件，链接的recv在FILES_UPDATE完成后才查找文件
+        s.fd_value = fd;
+        struct io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = (uint64_t)(uintptr_t)&s.fd_value;
+        sqe->len = 1;
+        sqe->off = fd;
+        sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = make_user_data(OP_IGNORE, fd);
+    }
+    arm_recv(fd);
+}
+
+void UringReactor::on_recv(int fd, int res, uint32_t flags) {
+    Slot& s = m_slots[fd];
+    bool more = flags & IORING_CQE_F_MORE;
+    if (!more) {
+        s.recv_armed = false;
+        s.recv_paused = false;
+        s.inflight--;
+    }
+    if (res > 0) {
+        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        m_free_bufs--;
+        if (s.state == SLOT_READING) {
+            bool ok = m_users[fd].append_input(m_bufs + (size_t)bid * BUF_SIZE, res);
+            recycle(bid);
+            if (!ok) {
+                // 请求超过max_request_size
+                close_conn(fd);
+                return;
+            }
+            mark_ready(fd);
+        } else if (s.state == SLOT_BUSY || s.state == SLOT_SENDING) {
+            // 连接正在被处理，数据暂存在缓冲区中
+            m_buf_len[bid] = res;
+            m_buf_next[bid] = 0;
+            if (s.tail) {
+                m_buf_next[s.tail - 1] = bid + 1;
+            } else {
+                s.head = bid + 1;
+            }
+            s.tail = bid + 1;
+            s.held++;
+            if (s.held >= MAX_HELD_BUFS && more && !s.recv_paused) {
+                // 之后的数据留在套接字缓冲区中，由TCP流量控制限制对端，等deliver交给连接后再恢复接收
+                pause_recv(fd);
+            }
+        } else {
+            recycle(bid);
+        }
+        if (!more && wants_recv(s)) {
+            arm_recv(fd);
+        }
+    } else if (res == -ENOBUFS) {
+        // 接收缓冲区暂时用尽，等有缓冲区归还后重新提交
+        if (s.state != SLOT_CLOSING && s.state != SLOT_FREE) {
+            m_starved.push_back(fd);
+        }
+    } else if (res == -ECANCELED && s.state != SLOT_CLOSING && s.state != SLOT_FREE) {
+        // pause_recv取消的recv：取消完成前连接已经取走了暂存的数据时，在这里恢复接收
+        if (wants_recv(s)) {
+            if (m_free_bufs > 0) {
+                arm_recv(fd);
+            } else {
+                m_starved.push_back(fd);
+            }
+        }
+    } else if (s.state == SLOT_READING) {
+        // 对端关闭或出错
+        DPRINT("[%d]Recv finished: %d", fd, res);
+        close_conn(fd);
+        return;
+    } else if (s.state == SLOT_BUSY || s.state == SLOT_SENDING) {
+        s.eof = true;
+    }
+    maybe_finish_close(fd);
+}
+
+void UringReactor::on_send(int fd, int res) {
+    Slot& s = m_slots[fd];
+    s.inflight--;
+    if (s.send) {
+        m_pool->free((char*)s.send, send_req_block(sizeof(SendReq)));
+        s.send = NULL;
+    }
+    if (s.state == SLOT_CLOSING) {
+        maybe_finish_close(fd);
+        return;
+    }
+    bool linked = s.shutdown_linked;
+    s.shutdown_linked = false;
+    // 之后的状态由send_done发出的rearm决定
+    s.state = SLOT_BUSY;
+    HTTPConn& conn = m_users[fd];
+    if (!conn.send_done(res)) {
+        if (res < 0 || !linked) {
+            conn.close_conn_write();
+        }
+    } else if (conn.has_pending_input()) {
+        // 管线化的后续请求已在读缓冲区中
+        s.state = SLOT_READING;
+        mark_ready(fd);
+    }
+}
+
+void UringReactor::on_rearm(const Rearm& r) {
+    Slot& s = m_slots[r.fd];
+    if (s.gen != r.gen || s.state == SLOT_FREE || s.state == SLOT_CLOSING) {
+        // 连接已经关闭
+        return;
+    }
+    if (r.ev & EPOLLOUT) {
+        submit_send(r.fd);
+        return;
+    }
+    s.state = SLOT_READING;
+    deliver(r.fd);
+}
+
+// 连接回到等待数据的状态：交给它处理期间暂存的数据，或者处理期间收到的EOF
+void UringReactor::deliver(int fd) {
+    Slot& s = m_slots[fd];
+    if (s.head) {
+        bool ok = true;
+        for (int b = s.head; b != 0;) {
+            int bid = b - 1;
+            b = m_buf_next[bid];
+            ok = ok && m_users[fd].append_input(m_bufs + (size_t)bid * BUF_SIZE, m_buf_len[bid]);
+            recycle(bid);
+        }
+        s.head = s.tail = 0;
+        s.held = 0;
+        if (!ok) {
+            close_conn(fd);
+            return;
+        }
+        if (!s.recv_armed) {
+            // 暂存的缓冲区达到上限时暂停了接收（见on_recv）
+            if (m_free_bufs > 0) {
+                arm_recv(fd);
+            } else {
+                m_starved.push_back(fd);
+            }
+        }
+        mark_ready(fd);
+        return;
+    }
+    if (s.eof) {
+        close_conn(fd);
+        return;
+    }
+    if (!s.recv_armed && m_free_bufs > 0) {
+        arm_recv(fd);
+    }
+}
+
+void UringReactor::mark_ready(int fd) {
+    Slot& s = m_slots[fd];
+    if (!s.ready) {
+        s.ready = true;
+        m_ready.push_back(fd);
+    }
+}
+
+// 同一轮中收到的数据都追加到读缓冲区之后，再交给dispatch处理
+void UringReactor::dispatch_ready() {
+    for (size_t i = 0; i < m_ready.size(); i++) {
+        int fd = m_ready[i];
+        Slot& s = m_slots[fd];
+        s.ready = false;
+        if (s.state != SLOT_READING) {
+            continue;
+        }
+        s.state = SLOT_BUSY;
+        m_dispatch(m_users + fd, m_dispatch_arg);
+    }
+    m_ready.clear();
+}
+
+void UringReactor::retry_starved() {
+    if (m_starved.empty() || m_free_bufs == 0) {
+        return;
+    }
+    for (size_t i = 0; i < m_starved.size(); i++) {
+        int fd = m_starved[i];
+        Slot& s = m_slots[fd];
+        if (!s.recv_armed && wants_recv(s)) {
+            arm_recv(fd);
+        }
+    }
+    m_starved.clear();
+}
+
+void UringReactor::run(Dispatch dispatch, void* arg) {
+    m_dispatch = dispatch;
+    m_dispatch_arg = arg;
+    t_current = this;
+    arm_accept();
+    arm_event();
+    std::vector<TimerWheel::Node*> expired;
+    while (true) {
+        // 处理完成事件
+        unsigned head = *m_cq_khead;
+        while (true) {
+            unsigned tail = __atomic_load_n(m_cq_ktail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                break;
+            }
+            for (; head != tail; head++) {
+                on_cqe(&m_cqes[head & m_cq_mask]);
+                m_cqe_count.fetch_add(1, std::memory_order_relaxed);
+            }
+            __atomic_store_n(m_cq_khead, head, __ATOMIC_RELEASE);
+        }
+
+        // 处理rearm和已收到数据的连接；run-to-completion模式下dispatch会在本线程内产生新的rearm
+        do {
+            for (size_t i = 0; i < m_local.size(); i++) {
+                Rearm r = m_local[i];
+                on_rearm(r);
+            }
+            m_local.clear();
+            Rearm r;
+            while (m_remote.pop(r)) {
+                on_rearm(r);
+            }
+            dispatch_ready();
+        } while (!m_local.empty());
+        retry_starved();
+
+        m_timers->expire(TimerWheel::now_ms(), HTTPConn::timer_check, expired);
+        for (size_t i = 0; i < expired.size(); i++) {
+            ((HTTPConn*)expired[i]->owner)->expire_timeout();
+        }
+        expired.clear();
+
+        publish_buffers();
+        // 一次系统调用完成提交和等待，超时时间由时间轮决定
+        enter(0, 1, m_timers->next_timeout(TimerWheel::now_ms()));
+    }
+}
+
+UringReactor::Stats UringReactor::stats() const {
+    Stats s;
+    s.enters = m_enters.load(std::memory_order_relaxed);
+    s.sqes = m_sqe_count.load(std::memory_order_relaxed);
+    s.cqes = m_cqe_count.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,47 @@
+// 把二进制格式的访问日志（access_log_binary = yes）转换为文本，格式与文本日志相同
+// 用法：access_log_decode [file]，不指定文件时从标准输入读取；可以用于正在写入的日志文件
+
+#include <stdio.h>
+#include <string.h>
+#include "access_log.h"
+
+static const size_t BATCH = 1024;
+
+int main(int argc, char* argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [file]\n", argv[0]);
+        return 2;
+    }
+    FILE* in = stdin;
+    if (argc == 2 && strcmp(argv[1], "-") != 0) {
+        in = fopen(argv[1], "rb");
+        if (!in) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+    AccessLogHeader h;
+    if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, ACCESS_LOG_MAGIC, sizeof(h.magic)) != 0) {
+        fprintf(stderr, "not a binary access log\n");
+        return 1;
+    }
+    if (h.version != ACCESS_LOG_VERSION || h.record_size != sizeof(AccessRecord)) {
+        fprintf(stderr, "unsupported access log version %u (record size %u)\n", h.version, h.record_size);
+        return 1;
+    }
+    static AccessRecord records[BATCH];
+    static char out[BATCH * 512];
+    size_t n;
+    while ((n = fread(records, sizeof(AccessRecord), BATCH, in)) > 0) {
+        size_t len = 0;
+        for (size_t i = 0; i < n; i++) {
+            len += format_access_record(records[i], out + len, sizeof(out) - len);
+        }
+        fwrite(out, 1, len, stdout);
+    }
+    if (ferror(in)) {
+        perror("read");
+        return 1;
+    }
+    return 0;
+}